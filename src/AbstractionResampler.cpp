@@ -1,13 +1,44 @@
 #include "AbstractionResampler.hpp"
+#include "Parallel.hpp"
+#include "SlicKernel.hpp"
+#include "PaletteKernel.hpp"
+#include "SymmetricEigen.hpp"
 
 #include <cmath>
+#include <algorithm>
+#include <limits>
 
 USE_PRJ_NAMESPACE;
 
+/// grid rows per stripe of the parallel superpixel reduction
+static const SizeType reduce_stripe_rows = 4;
+
+/// first pixel of each of n_cells equal cells along an axis, plus n_pixels
+static void cell_bounds(SizeType n_pixels, SizeType n_cells, std::vector<SizeType> & bounds)
+{
+  const Real s = (Real)n_pixels / n_cells;
+  bounds.assign(n_cells+1, n_pixels);
+  for ( SizeType x=n_pixels; x-- > 0; )
+  {
+    bounds[std::min(SizeType(x/s), n_cells-1)] = x;
+  }
+  for ( SizeType i=n_cells; i-- > 0; )
+  {
+    bounds[i] = std::min(bounds[i], bounds[i+1]);
+  }
+}
+
 void AbstractionResampler::resample(SizeType w, SizeType h)
+{
+  resample(w, h, ConvergencePolicy());
+}
+
+void AbstractionResampler::resample(SizeType w, SizeType h, const ConvergencePolicy & policy)
 {
   INFO("resample()");
 
+  _policy = policy;
+  _start_time = std::chrono::steady_clock::now();
   initialize(w, h);
 
   while ( !is_done() )
@@ -23,57 +54,53 @@ void AbstractionResampler::initialize(const SizeType w, const SizeType h)
   INFO("initialize()");
 
   // prepare input and output
-  _input_width = _input.cols;
-  _input_height = _input.rows;
   _output_width = w;
   _output_height = h;
-  _input_area = Real(_input_width*_input_height);
   _output_area = Real(_output_width*_output_height);
-  bgr2lab(_input, _input_lab);
-  _output_lab = cv::Mat(cv::Size(w, h), CV_32FC3, cv::Scalar(0.0));
 
   // prepare intermediate variables
   _converged = false;
   _palette_maxed = false;
   _iteration = 0;
-  _range = std::sqrt(_input_area/_output_area);
-
-  // init superpixels and pixel map
-  _superpixels.clear();
-  _pixel_map.clear();
-  for ( SizeType i=0; i < _input_width; i++ )
-  {
-    std::vector<SizeType> col;
-    for ( SizeType j=0; j < _input_height; j++)
+  _iteration_seconds = 0;
+  _best_palette.clear();
+  _best_assoc.clear();
+  _best_colors = 0;
+  _best_error = 0;
+
+  // init superpixels
+  _n_superpixels = _output_width*_output_height;
+  _sp_position.resize(_n_superpixels);
+  _sp_color.assign(_n_superpixels, cv::Vec3f(0.0, 0.0, 0.0));
+  _sp_assoc.assign(_n_superpixels, 0);
+  for ( SizeType j=0; j < _output_height; j++ )
+    for ( SizeType i=0; i < _output_width; i++ )
     {
-      col.push_back(0);
+      const SizeType k = j*_output_width+i;
+      _sp_position[k] = cv::Vec2f((i+0.5)/_output_width, (j+0.5)/_output_height);
     }
-    _pixel_map.push_back(col);
+  _search_windows.resize(_n_superpixels);
+  _n_stripes = (_output_height+reduce_stripe_rows-1) / reduce_stripe_rows;
+  _stripe_offsets.resize(_n_stripes+1);
+  _stripe_offsets[0] = 0;
+  for ( SizeType s=0; s < _n_stripes; s++ )
+  {
+    const SizeType g0 = s*reduce_stripe_rows;
+    const SizeType lo = g0 > 0 ? g0-1 : 0;
+    const SizeType hi = std::min(g0+reduce_stripe_rows+1, _output_height);
+    _stripe_offsets[s+1] = _stripe_offsets[s] + (hi-lo)*_output_width;
   }
-  const Real sx = (Real)_input_width / _output_width;
-  const Real sy = (Real)_input_height / _output_height;
-  for ( SizeType i=0; i < _output_width; i++ )
-    for ( SizeType j=0; j < _output_height; j++ )
-    {
-      SuperPixel p(i*h+j);
-      p.position = cv::Vec2f((i+0.5)/_output_width, (j+0.5)/_output_height);
-      p.color = cv::Vec3f(0.0, 0.0, 0.0);
-      _superpixels.push_back(p);
-
-      // build mapping from pixels to this superpixel
-      for ( SizeType x=i*sx; x < (i+1)*sx; x++ )
-        for ( SizeType y=j*sy; y < (j+1)*sy; y++ )
-        {
-          _pixel_map[x][y] = p.id;
-        }
-    }
+  _moments.resize(_stripe_offsets[_n_stripes]);
+  _smoothed_position.resize(_n_superpixels);
+
+  prepare_input();
   update_superpixels();
 
   // init palette
   cv::Vec3f first_color(0.0, 0.0, 0.0);
-  for ( SizeType k=0; k < _superpixels.size(); k++ )
+  for ( SizeType k=0; k < _n_superpixels; k++ )
   {
-    first_color += _superpixels[k].color;
+    first_color += _sp_color[k];
   }
   first_color /= _output_area;
   _palette.clear();
@@ -81,39 +108,182 @@ void AbstractionResampler::initialize(const SizeType w, const SizeType h)
 
   // init MCDA
   _prob_o = 1.0 / _output_area;
+  if ( !_fixed_lab.empty() )
+  {
+    initialize_fixed_palette();
+    return;
+  }
   _prob_c.clear();
   _prob_c.push_back(0.5);
   _prob_c.push_back(0.5);
-  _prob_co.clear();
-  _prob_co.push_back(std::vector<Real>(_output_width*_output_height, 0.5));
-  _prob_co.push_back(std::vector<Real>(_output_width*_output_height, 0.5));
+  _prob_co.reserve((2*_nColors+2)*_n_superpixels);
+  _prob_co.assign(2*_n_superpixels, 0.5);
   _palette.push_back(first_color + 0.8 * get_max_eigen(0).first);
   _sub_superpixel_pairs.clear();
   _sub_superpixel_pairs.push_back(std::pair<SizeType,SizeType>(0,1));
   _temperature = 1.1 * std::sqrt(2*get_max_eigen(0).second);
 }
 
+void AbstractionResampler::prepare_input()
+{
+  INFO("prepare_input()");
+
+  _pyramid.resize(1);
+  bgr_to_lab_planes(_input, _pyramid[0][0], _pyramid[0][1], _pyramid[0][2]);
+
+  // coarser copies of the input, each level halves the size as long as
+  // there are still at least 2x2 pixels per superpixel
+  while ( _pyramid.size() <= _pyramid_levels )
+  {
+    const std::array<cv::Mat, 3> & fine = _pyramid.back();
+    const cv::Size size(fine[0].cols/2, fine[0].rows/2);
+    if ( SizeType(size.width) < 2*_output_width ||
+         SizeType(size.height) < 2*_output_height ) break;
+    std::array<cv::Mat, 3> coarse;
+    for ( int c=0; c < 3; c++ )
+    {
+      cv::resize(fine[c], coarse[c], size, 0, 0, cv::INTER_AREA);
+    }
+    _pyramid.push_back(coarse);
+  }
+
+  if ( _fixed_point_lab )
+  {
+    for ( SizeType level=0; level < _pyramid.size(); level++ )
+      for ( int c=0; c < 3; c++ )
+      {
+        cv::Mat fixed;
+        _pyramid[level][c].convertTo(fixed, CV_16S, 1.0/lab_fixed_step);
+        _pyramid[level][c] = fixed;
+      }
+  }
+
+  // start from the coarsest level
+  _pixel_map.reserve(_input.cols*_input.rows);
+  _distance_map.reserve(_input.cols*_input.rows);
+  set_level(_pyramid.size()-1);
+}
+
+void AbstractionResampler::set_level(SizeType level)
+{
+  INFO("set_level(): %lu", level);
+
+  // Only the pixel side depends on the resolution: superpixel positions
+  // are normalized and the palette, probabilities and temperature are
+  // all in Lab, so they carry over between levels unchanged.
+  _level = level;
+  _lab_planes = _pyramid[level];
+  set_input_size(_lab_planes[0].cols, _lab_planes[0].rows);
+
+  // map pixels to the superpixel grid
+  _pixel_map.assign(_input_width*_input_height, 0);
+  _distance_map.assign(_input_width*_input_height, std::numeric_limits<float>::max());
+  const Real sx = (Real)_input_width / _output_width;
+  const Real sy = (Real)_input_height / _output_height;
+  for ( SizeType j=0; j < _output_height; j++ )
+    for ( SizeType i=0; i < _output_width; i++ )
+    {
+      const SizeType k = j*_output_width+i;
+      for ( SizeType y=j*sy; y < (j+1)*sy; y++ )
+        for ( SizeType x=i*sx; x < (i+1)*sx; x++ )
+        {
+          _pixel_map[y*_input_width+x] = k;
+        }
+    }
+}
+
+void AbstractionResampler::set_input_size(SizeType w, SizeType h)
+{
+  _input_width = w;
+  _input_height = h;
+  _input_area = Real(_input_width*_input_height);
+  _range = std::sqrt(_input_area/_output_area);
+  cell_bounds(_input_width, _output_width, _cell_x);
+  cell_bounds(_input_height, _output_height, _cell_y);
+}
+
+void AbstractionResampler::initialize_fixed_palette()
+{
+  INFO("initialize_fixed_palette(): %lu colors", SizeType(_fixed_lab.size()));
+
+  // the critical temperature of the whole image, as in the regular
+  // schedule, from a single entry at the mean color
+  _prob_c.assign(1, 1.0);
+  _prob_co.assign(_n_superpixels, 1.0);
+  _temperature = 1.1 * std::sqrt(2*get_max_eigen(0).second);
+
+  const SizeType palette_size = _fixed_lab.size();
+  _palette = _fixed_lab;
+  _palette_maxed = true;
+  _sub_superpixel_pairs.clear();
+  _prob_c.assign(palette_size, 1.0/palette_size);
+  _prob_co.assign(palette_size*_n_superpixels, 1.0/palette_size);
+
+  // start the search windows from the nearest palette colors
+  associate_superpixels();
+}
+
 bool AbstractionResampler::is_done()
 {
   INFO("is_done()");
 
-  if ( _iteration > 100 )
+  if ( _converged )
   {
     return true;
   }
-  return _converged;
+  if ( _policy.max_iterations && _iteration >= _policy.max_iterations )
+  {
+    INFO("is_done(): iteration limit reached");
+    return true;
+  }
+  if ( _policy.time_budget > 0 )
+  {
+    // stop unless another iteration like the last one still fits
+    const double elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - _start_time).count();
+    if ( elapsed + _iteration_seconds > _policy.time_budget )
+    {
+      INFO("is_done(): time budget reached after %.3fs", elapsed);
+      return true;
+    }
+  }
+  return false;
 }
 
 void AbstractionResampler::iterate()
 {
   INFO("iterate(): %lu", _iteration++);
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
   remap_pixels();
   update_superpixels();
 
   associate_superpixels();
+  if ( !_fixed_lab.empty() )
+  {
+    // the palette is prescribed, so only the superpixels and their soft
+    // association anneal, halving the temperature every iteration
+    if ( _temperature <= 1.0 )
+    {
+      _converged = true;
+    }
+    else
+    {
+      _temperature = std::max(1.0, 0.5*_temperature);
+    }
+    if ( _level > 0 )
+    {
+      set_level(_level-1);
+      _converged = false;
+    }
+    _iteration_seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    return;
+  }
+
   Real err = refine_palette();
-  if ( err < 1.0 )
+  keep_best(err);
+  if ( err < _policy.palette_error )
   {
     if ( _temperature <= 1.0 )
     {
@@ -123,27 +293,79 @@ void AbstractionResampler::iterate()
     {
       _temperature = std::max(1.0, 0.7*_temperature);
     }
+    const SizeType palette_size = _palette.size();
     expand_palette();
+
+    // move one pyramid level finer whenever the palette grows, and never
+    // converge before reaching the full resolution
+    if ( _level > 0 && (_converged || _palette.size() != palette_size) )
+    {
+      set_level(_level-1);
+      _converged = false;
+    }
+  }
+
+  _iteration_seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+void AbstractionResampler::keep_best(Real error)
+{
+  // more colors is further along, the same number is compared by error
+  const SizeType n_colors = _sub_superpixel_pairs.size();
+  if ( !_best_assoc.empty() &&
+       (n_colors < _best_colors || (n_colors == _best_colors && error >= _best_error)) )
+  {
+    return;
   }
+  _best_palette = get_averaged_palette();
+  _best_assoc = _sp_assoc;
+  _best_colors = n_colors;
+  _best_error = error;
 }
 
 void AbstractionResampler::finalize()
 {
   INFO("finalize()");
 
-  const std::vector<cv::Vec3f> & averaged_palette = get_averaged_palette();
-  for ( SizeType i=0; i < _output_width; i++ )
-    for ( SizeType j=0; j < _output_height; j++ )
+  // a run cut short may have just expanded the palette, it ends with
+  // the best state that was refined instead
+  const bool use_best = !_converged && !_best_assoc.empty();
+  const std::vector<LabelType> & sp_assoc = use_best ? _best_assoc : _sp_assoc;
+
+  // every output pixel is a palette color, so only the palette is
+  // converted back to BGR
+  std::vector<cv::Vec3b> palette_bgr;
+  if ( !_fixed_lab.empty() )
+  {
+    // exactly the prescribed colors, no averaging or saturation boost
+    palette_bgr = _fixed_bgr;
+  }
+  else
+  {
+    std::vector<cv::Vec3f> boosted = use_best ? _best_palette : get_averaged_palette();
+    for ( SizeType k=0; k < boosted.size(); k++ )
     {
-      const SuperPixel & sp = _superpixels[i*_output_height+j];
-      _output_lab.at<cv::Vec3f>(j, i) = averaged_palette[sp.assoc];
-	  _output_lab.at<cv::Vec3f>(j, i)[1] *= 1.1;
-	  _output_lab.at<cv::Vec3f>(j, i)[2] *= 1.1;
+      boosted[k][1] *= 1.1;
+      boosted[k][2] *= 1.1;
     }
-  lab2bgr(_output_lab, _output);
+    palette_bgr.resize(boosted.size());
+    lab_to_bgr(&boosted[0], &palette_bgr[0], boosted.size());
+  }
+
+  _output.create(_output_height, _output_width, CV_8UC3);
+  for ( SizeType j=0; j < _output_height; j++ )
+  {
+    cv::Vec3b * row = _output.ptr<cv::Vec3b>(int(j));
+    const LabelType * assoc = &sp_assoc[j*_output_width];
+    for ( SizeType i=0; i < _output_width; i++ )
+    {
+      row[i] = palette_bgr[assoc[i]];
+    }
+  }
 }
 
-void AbstractionResampler::visualizeSuperpixel(cv::Mat & output)
+void AbstractionResampler::visualizeSuperpixel(cv::Mat & output, SizeType scale)
 {
   INFO("visualizeSuperpixel()");
 
@@ -156,63 +378,70 @@ void AbstractionResampler::visualizeSuperpixel(cv::Mat & output)
   const int dx[n_neighbors] = {-1,  0,  1, 1, 1};
   const int dy[n_neighbors] = {-1, -1, -1, 0, 1};
 #endif
-  output = _input.clone(); // in BGR space with type CV_8UC3
+  ASSERT(scale >= 1);
+  if ( _level > 0 )
+  {
+    // the run stopped on a coarse level, the output only needs the
+    // superpixels but the overlay needs the full resolution pixel map
+    set_level(0);
+    remap_pixels();
+  }
+  const int w = int(std::max(SizeType(1), _input_width/scale));
+  const int h = int(std::max(SizeType(1), _input_height/scale));
+  output.create(h, w, CV_8UC3);
+
+  // palette color of every superpixel, converted once
+  std::vector<cv::Vec3b> palette_bgr(_palette.size());
+  lab_to_bgr(&_palette[0], &palette_bgr[0], _palette.size());
+  std::vector<cv::Vec3b> sp_bgr(_n_superpixels);
+  for ( SizeType k=0; k < _n_superpixels; k++ )
+  {
+    sp_bgr[k] = palette_bgr[_sp_assoc[k]];
+  }
 
-  // palette color
-  //if ( false )
+  // palette color and contour in one pass, every scale-th pixel of the map
+  parallel_for(0, SizeType(h), [&](SizeType j)
   {
-    for ( SizeType id=0; id < _palette.size(); id++ )
+    const LabelType * rows[3];
+    for ( int r=0; r < 3; r++ )
     {
-      for ( int i=0; i < output.cols; i++ )
-        for ( int j=0; j < output.rows; j++ )
-          if ( _pixel_map[i][j] == id )
-          {
-            output.at<cv::Vec3b>(j, i) = lab2bgr(_palette[id]);
-          }
+      const int y = std::min(std::max(int(j)+r-1, 0), h-1);
+      rows[r] = &_pixel_map[SizeType(y)*scale*_input_width];
     }
-  }
-
-  // contour
-  for ( int i=0; i < output.cols; i++ )
-    for ( int j=0; j < output.rows; j++ )
+    cv::Vec3b * out = output.ptr<cv::Vec3b>(int(j));
+    for ( int i=0; i < w; i++ )
     {
-      SizeType id = _pixel_map[i][j];
+      const LabelType id = rows[1][i*scale];
       SizeType cnt = 0;
       for ( int k=0; k < n_neighbors; k++ )
       {
-        int x = i + dx[k];
-        int y = j + dy[k];
-        if ( 0 <= x && x < output.cols &&
-             0 <= y && y < output.rows &&
-             _pixel_map[x][y] != id )
+        const int x = i + dx[k];
+        const int y = int(j) + dy[k];
+        if ( 0 <= x && x < w &&
+             0 <= y && y < h &&
+             rows[1+dy[k]][x*scale] != id )
         {
           cnt++;
         }
       }
-      if ( cnt > 1 )
-      {
-        output.at<cv::Vec3b>(j, i) = cv::Vec3b(0, 0, 255);
-      }
+      out[i] = cnt > 1 ? cv::Vec3b(0, 0, 255) : sp_bgr[id];
     }
+  });
 
-  // superpixel center
-  //if ( false )
+  // superpixel centers, only a few pixels each
+  for ( SizeType k=0; k < _n_superpixels; k++ )
   {
-    for ( SizeType i=0; i < _superpixels.size(); i++ )
+    const int x = std::min(int(_sp_position[k][0]*w), w-1);
+    const int y = std::min(int(_sp_position[k][1]*h), h-1);
+    output.at<cv::Vec3b>(y, x) = cv::Vec3b(0, 255, 0);
+    for ( int n=0; n < n_neighbors; n++ )
     {
-      const SuperPixel & sp = _superpixels[i];
-      const int x = (int)(sp.position[0]*_input_width);
-      const int y = (int)(sp.position[1]*_input_height);
-      output.at<cv::Vec3b>(y, x) = cv::Vec3b(0, 255, 0);
-      for ( int k=0; k < n_neighbors; k++ )
+      const int xx = x+dx[n];
+      const int yy = y+dy[n];
+      if ( 0 <= xx && xx < w &&
+           0 <= yy && yy < h )
       {
-        int xx = x+dx[k];
-        int yy = y+dy[k];
-        if ( 0 <= xx && xx < output.cols &&
-             0 <= yy && yy < output.rows )
-        {
-          output.at<cv::Vec3b>(yy, xx) = cv::Vec3b(0, 255, 0);
-        }
+        output.at<cv::Vec3b>(yy, xx) = cv::Vec3b(0, 255, 0);
       }
     }
   }
@@ -222,184 +451,323 @@ void AbstractionResampler::remap_pixels()
 {
   INFO("remap_pixels()");
 
-  std::vector<std::vector<Real> > dmap;
-  for ( SizeType i=0; i < _input_width; i++ )
+  // Every pixel only competes for the superpixels of the 3x3 grid cells
+  // around it, so rows are independent and can be assigned in parallel
+  // tiles without any shared writes.
+  static const SizeType tile_rows = 16;
+
+  prepare_search_windows();
+  const SizeType n_tiles = (_input_height+tile_rows-1) / tile_rows;
+  parallel_for(0, n_tiles, [&](SizeType tile)
   {
-    std::vector<Real> col;
-    for ( SizeType j=0; j < _input_height; j++ )
+    const SizeType j0 = tile*tile_rows;
+    const SizeType j1 = std::min(j0+tile_rows, _input_height);
+    for ( SizeType j=j0; j < j1; j++ )
     {
-      col.push_back(Real(-1));
-    }
-    dmap.push_back(col);
-  }
-  const std::vector<cv::Vec3f> & averaged_palette = get_averaged_palette();
-  for ( SizeType k=0; k < _superpixels.size(); k++ )
-  {
-    const SizeType x = _superpixels[k].position[0]*_input_width;
-    const SizeType y = _superpixels[k].position[1]*_input_height;
-    const SizeType x0 = std::max(Real(0), x-_range);
-    const SizeType y0 = std::max(Real(0), y-_range);
-    const SizeType x1 = std::min(Real(_input_width), x+_range);
-    const SizeType y1 = std::min(Real(_input_height), y+_range);
-    const cv::Vec3f color = averaged_palette[_superpixels[k].assoc];
-    for ( SizeType i=x0; i < x1; i++ )
-      for ( SizeType j=y0; j < y1; j++ )
+      if ( _lab_planes[0].depth() == CV_16S )
       {
-        const Real d = slic_distance(i, j, cv::Vec2f(x, y), color);
-        if ( dmap[i][j] > d || dmap[i][j] < 0 )
-        {
-          dmap[i][j] = d;
-          _pixel_map[i][j] = k;
-        }
+        remap_row(j, _lab_planes[0].ptr<int16_t>(j), _lab_planes[1].ptr<int16_t>(j),
+                  _lab_planes[2].ptr<int16_t>(j), &_distance_map[j*_input_width],
+                  &_pixel_map[j*_input_width]);
       }
+      else
+      {
+        remap_row(j, _lab_planes[0].ptr<float>(j), _lab_planes[1].ptr<float>(j),
+                  _lab_planes[2].ptr<float>(j), &_distance_map[j*_input_width],
+                  &_pixel_map[j*_input_width]);
+      }
+    }
+  });
+}
+
+void AbstractionResampler::prepare_search_windows()
+{
+  const std::vector<cv::Vec3f> & averaged_palette = get_averaged_palette();
+  for ( SizeType k=0; k < _n_superpixels; k++ )
+  {
+    const SizeType x = _sp_position[k][0]*_input_width;
+    const SizeType y = _sp_position[k][1]*_input_height;
+    SearchWindow & win = _search_windows[k];
+    win.x0 = SizeType(std::max(Real(0), x-_range));
+    win.y0 = SizeType(std::max(Real(0), y-_range));
+    win.x1 = SizeType(std::min(Real(_input_width), x+_range));
+    win.y1 = SizeType(std::min(Real(_input_height), y+_range));
+    win.center = cv::Vec2f(x, y);
+    win.color = averaged_palette[_sp_assoc[k]];
   }
 }
 
+template <typename T>
+void AbstractionResampler::remap_row(SizeType j, const T * L, const T * a,
+                                     const T * b, float * dist, LabelType * label) const
+{
+  // Within a row, each candidate scores the span of pixels that sees it
+  // as a neighbour.
+  const float weight = 45.0 / _range;
+  const Real sy = (Real)_input_height / _output_height;
+  std::fill(dist, dist+_input_width, std::numeric_limits<float>::max());
+
+  const SizeType cy = std::min(SizeType(j/sy), _output_height-1);
+  const SizeType cy0 = cy > 0 ? cy-1 : 0;
+  const SizeType cy1 = std::min(cy+2, _output_height);
+  // candidates are visited in increasing superpixel id, so ties
+  // resolve exactly like a scan over superpixels would
+  for ( SizeType cj=cy0; cj < cy1; cj++ )
+    for ( SizeType ci=0; ci < _output_width; ci++ )
+    {
+      const SizeType k = cj*_output_width+ci;
+      const SearchWindow & win = _search_windows[k];
+      if ( SIntType(j) < win.y0 || SIntType(j) >= win.y1 ) continue;
+      const SizeType i0 = std::max(SizeType(win.x0), _cell_x[ci > 0 ? ci-1 : 0]);
+      const SizeType i1 = std::min(SizeType(win.x1), _cell_x[std::min(ci+2, _output_width)]);
+      slic_span(L, a, b, dist, label, i0, i1, j,
+                win.center.val, win.color.val, weight, k);
+    }
+}
+
 void AbstractionResampler::update_superpixels()
 {
   INFO("update_superpixels()");
 
-  std::vector<SizeType> counter;
-  const std::vector<SuperPixel> superpixels = _superpixels;
-  for ( SizeType k=0; k < _superpixels.size(); k++ )
+  // Each stripe of grid rows sums its pixels into private moments. Pixels
+  // only ever belong to superpixels of neighbouring grid rows, so a stripe
+  // needs moments for its own rows plus one row above and below.
+  parallel_for(0, _n_stripes, [&](SizeType s)
   {
-    _superpixels[k].position = cv::Vec2f(0.0, 0.0);
-    _superpixels[k].color = cv::Vec3f(0.0, 0.0, 0.0);
-    counter.push_back(0);
-  }
-  for ( SizeType i=0; i < _input_width; i++ )
-    for ( SizeType j=0; j < _input_height; j++ )
+    SizeType y0, y1;
+    stripe_bounds(s, y0, y1);
+    clear_stripe(s);
+    for ( SizeType j=y0; j < y1; j++ )
     {
-      SizeType id = _pixel_map[i][j];
-      _superpixels[id].position += cv::Vec2f(Real(i)/_input_width, Real(j)/_input_height);
-      _superpixels[id].color += _input_lab.at<cv::Vec3f>(j, i);
-      counter[id]++;
+      if ( _lab_planes[0].depth() == CV_16S )
+      {
+        accumulate_row(s, j, _lab_planes[0].ptr<int16_t>(j), _lab_planes[1].ptr<int16_t>(j),
+                       _lab_planes[2].ptr<int16_t>(j), &_pixel_map[j*_input_width]);
+      }
+      else
+      {
+        accumulate_row(s, j, _lab_planes[0].ptr<float>(j), _lab_planes[1].ptr<float>(j),
+                       _lab_planes[2].ptr<float>(j), &_pixel_map[j*_input_width]);
+      }
     }
-  for ( SizeType k=0; k < _superpixels.size(); k++ )
+  });
+
+  resolve_superpixels();
+}
+
+void AbstractionResampler::stripe_bounds(SizeType s, SizeType & y0, SizeType & y1) const
+{
+  const SizeType g0 = s*reduce_stripe_rows;
+  const SizeType g1 = std::min(g0+reduce_stripe_rows, _output_height);
+  y0 = _cell_y[g0];
+  y1 = _cell_y[g1];
+}
+
+void AbstractionResampler::clear_stripe(SizeType s)
+{
+  std::fill(_moments.begin()+_stripe_offsets[s],
+            _moments.begin()+_stripe_offsets[s+1], Moments());
+}
+
+template <typename T>
+void AbstractionResampler::accumulate_row(SizeType s, SizeType j, const T * L,
+                                          const T * a, const T * b,
+                                          const LabelType * label)
+{
+  const SizeType g0 = s*reduce_stripe_rows;
+  const SizeType base = (g0 > 0 ? g0-1 : 0)*_output_width;
+  Moments * m = &_moments[_stripe_offsets[s]];
+  const SizeType n = _stripe_offsets[s+1]-_stripe_offsets[s];
+  for ( SizeType i=0; i < _input_width; i++ )
   {
-    if ( counter[k] )
-    {
-      _superpixels[k].position /= Real(counter[k]);
-      _superpixels[k].color /= Real(counter[k]);
-    }
-    else
-    {
-      _superpixels[k].position = superpixels[k].position;
-      SizeType x = superpixels[k].position[0] * _input_width;
-      SizeType y = superpixels[k].position[1] * _input_height;
-      _superpixels[k].color = _input_lab.at<cv::Vec3f>(y, x);
-    }
+    const SizeType id = label[i]-base;
+    ASSERT(id < n);
+    Moments & mi = m[id];
+    mi.x += i;
+    mi.y += j;
+    mi.L += lab_value(L[i]);
+    mi.a += lab_value(a[i]);
+    mi.b += lab_value(b[i]);
+    mi.n++;
   }
+}
 
-  // position smoothing
-  std::vector<std::vector<cv::Vec2f> > p, newp;
-  for ( SizeType i=0; i < _output_width; i++ )
+void AbstractionResampler::resolve_superpixels()
+{
+  const SizeType w = _output_width;
+  const SizeType h = _output_height;
+
+  // merge the stripes touching each grid row, always in stripe order
+  parallel_for(0, h, [&](SizeType g)
   {
-    std::vector<cv::Vec2f> col, newcol;
-    for ( SizeType j=0; j < _output_height; j++ )
+    const SizeType s_begin = g/reduce_stripe_rows > 0 ? g/reduce_stripe_rows-1 : 0;
+    const SizeType s_end = std::min(g/reduce_stripe_rows+2, _n_stripes);
+    for ( SizeType i=0; i < w; i++ )
     {
-      col.push_back(_superpixels[i*_output_height+j].position);
-      newcol.push_back(cv::Vec2f(0.0, 0.0));
+      const SizeType k = g*w+i;
+      Moments sum;
+      for ( SizeType s=s_begin; s < s_end; s++ )
+      {
+        const SizeType g0 = s*reduce_stripe_rows;
+        const SizeType lo = g0 > 0 ? g0-1 : 0;
+        const SizeType hi = std::min(g0+reduce_stripe_rows+1, h);
+        if ( g < lo || g >= hi ) continue;
+        const Moments & m = _moments[_stripe_offsets[s]+k-lo*w];
+        sum.x += m.x;
+        sum.y += m.y;
+        sum.L += m.L;
+        sum.a += m.a;
+        sum.b += m.b;
+        sum.n += m.n;
+      }
+      if ( sum.n )
+      {
+        _sp_position[k] = cv::Vec2f(sum.x/sum.n/_input_width,
+                                    sum.y/sum.n/_input_height);
+        _sp_color[k] = cv::Vec3f(sum.L/sum.n, sum.a/sum.n, sum.b/sum.n);
+      }
+      else
+      {
+        // an empty superpixel keeps its position and samples the color there
+        SizeType x = _sp_position[k][0] * _input_width;
+        SizeType y = _sp_position[k][1] * _input_height;
+        _sp_color[k] = sample_input(x, y);
+      }
     }
-    p.push_back(col);
-    newp.push_back(newcol);
-  }
-  for ( SizeType i=0; i < _output_width; i++ )
-    for ( SizeType j=0; j < _output_height; j++ )
+  });
+
+  // position smoothing
+  parallel_for(0, h, [&](SizeType j)
+  {
+    for ( SizeType i=0; i < w; i++ )
     {
+      const SizeType k = j*w+i;
+      cv::Vec2f newp(0.0, 0.0);
       Real c(0);
-      if ( i > 0 ) { c+=1.0; newp[i][j] += p[i-1][j]; }
-      if ( j > 0 ) { c+=1.0; newp[i][j] += p[i][j-1]; }
-      if ( i < _output_width-1 ) { c+=1.0; newp[i][j] += p[i+1][j]; }
-      if ( j < _output_height-1 ) { c+=1.0; newp[i][j] += p[i][j+1]; }
+      if ( i > 0 ) { c+=1.0; newp += _sp_position[k-1]; }
+      if ( j > 0 ) { c+=1.0; newp += _sp_position[k-w]; }
+      if ( i < w-1 ) { c+=1.0; newp += _sp_position[k+1]; }
+      if ( j < h-1 ) { c+=1.0; newp += _sp_position[k+w]; }
       ASSERT(c>Real(0));
-      newp[i][j] /= c;
-    }
-  for ( SizeType i=0; i < _output_width; i++ )
-    for ( SizeType j=0; j < _output_height; j++ )
-    {
-      _superpixels[i*_output_height+j].position = 0.6 * p[i][j] + 0.4 * newp[i][j];
+      _smoothed_position[k] = 0.6 * _sp_position[k] + 0.4 * (newp / c);
     }
+  });
+  _sp_position.swap(_smoothed_position);
+
+  // color smoothing, viewing the superpixel colors as an image in place
+  // (cv::bilateralFilter runs on OpenCV's thread pool itself)
+  cv::Mat c(h, w, CV_32FC3, &_sp_color[0]);
+  cv::bilateralFilter(c, _smoothed_color, 3, 0, 0);
+  _smoothed_color.copyTo(c);
+  invalidate_covariances();
+}
 
-  // color smoothing
-  cv::Mat c(cv::Size(_output_width, _output_height), CV_32FC3);
-  cv::Mat newc;
-  for ( SizeType i=0; i < _output_width; i++ )
-    for ( SizeType j=0; j < _output_height; j++ )
-    {
-      c.at<cv::Vec3f>(j, i) = _superpixels[i*_output_height+j].color;
-    }
-  cv::bilateralFilter(c, newc, 3, 0, 0);
-  for ( SizeType i=0; i < _output_width; i++ )
-    for ( SizeType j=0; j < _output_height; j++ )
-    {
-      _superpixels[i*_output_height+j].color = newc.at<cv::Vec3f>(j, i);
-    }
+cv::Vec3f AbstractionResampler::sample_input(SizeType x, SizeType y) const
+{
+  if ( _lab_planes[0].depth() == CV_16S )
+  {
+    return cv::Vec3f(lab_value(_lab_planes[0].at<int16_t>(y, x)),
+                     lab_value(_lab_planes[1].at<int16_t>(y, x)),
+                     lab_value(_lab_planes[2].at<int16_t>(y, x)));
+  }
+  return cv::Vec3f(_lab_planes[0].at<float>(y, x),
+                   _lab_planes[1].at<float>(y, x),
+                   _lab_planes[2].at<float>(y, x));
 }
 
 void AbstractionResampler::associate_superpixels()
 {
   INFO("associate_superpixels()");
 
-  const SizeType palette_size = _palette.size();
-  std::vector<Real> new_prob_c(palette_size, 0.0);
-  _prob_co = std::vector<std::vector<Real> >(palette_size,
-      std::vector<Real>(_output_width*_output_height, 0.0));
-  const Real overT = -1.0/_temperature;
+  // superpixels per work item, fixed so the reduction order is too
+  static const SizeType chunk_size = 256;
 
-  for ( SizeType k=0; k < _superpixels.size(); k++ )
+  const SizeType palette_size = _palette.size();
+  const SizeType n_chunks = (_n_superpixels+chunk_size-1) / chunk_size;
+  _prob_co.resize(palette_size*_n_superpixels);
+
+  // planar copy of the palette and its priors for the vector kernels
+  _palette_planes.resize(4*palette_size);
+  float * const pL = &_palette_planes[0];
+  float * const pa = pL + palette_size;
+  float * const pb = pa + palette_size;
+  float * const prior = pb + palette_size;
+  for ( SizeType i=0; i < palette_size; i++ )
   {
-    SizeType best_index = palette_size;
-    Real best_error;
-    std::vector<Real> probs;
-    const cv::Vec3f pixel = _superpixels[k].color;
-    Real sum_prob(0);
+    pL[i] = _palette[i][0];
+    pa[i] = _palette[i][1];
+    pb[i] = _palette[i][2];
+    prior[i] = _prob_c[i];
+  }
+  _assoc_scratch.resize(2*palette_size*n_chunks);
+  _prob_c_partials.assign(palette_size*n_chunks, 0.0);
+  const float overT = -1.0/_temperature;
 
-    for ( SizeType i=0; i < palette_size; i++ )
+  parallel_for(0, n_chunks, [&](SizeType c)
+  {
+    float * errors = &_assoc_scratch[2*palette_size*c];
+    float * probs = errors + palette_size;
+    double * new_prob_c = &_prob_c_partials[palette_size*c];
+    const SizeType k1 = std::min((c+1)*chunk_size, _n_superpixels);
+    for ( SizeType k=c*chunk_size; k < k1; k++ )
     {
-      Real color_error = cv::norm(_palette[i], pixel);
-      Real prob = _prob_c[i] * std::exp(color_error*overT);
-      probs.push_back(prob);
-      sum_prob += prob;
-      if ( best_index == palette_size || color_error < best_error )
+      palette_distances(pL, pa, pb, palette_size, _sp_color[k].val, errors);
+      SizeType best_index = 0;
+      for ( SizeType i=1; i < palette_size; i++ )
+      {
+        if ( errors[i] < errors[best_index] )
+        {
+          best_index = i;
+        }
+      }
+      const float sum_prob = gibbs_weights(errors, prior, palette_size,
+                                           errors[best_index], overT, probs);
+      _sp_assoc[k] = best_index;
+      for ( SizeType i=0; i < palette_size; i++ )
       {
-        best_index = i;
-        best_error = color_error;
+        Real norm_prob = probs[i] / sum_prob;
+        _prob_co[i*_n_superpixels+k] = norm_prob;
+        new_prob_c[i] += norm_prob * _prob_o;
       }
     }
-    _superpixels[k].assoc = best_index;
-    for ( SizeType i=0; i < palette_size; i++ )
+  });
+
+  for ( SizeType i=0; i < palette_size; i++ )
+  {
+    double prob(0);
+    for ( SizeType c=0; c < n_chunks; c++ )
     {
-      Real norm_prob = probs[i] / sum_prob;
-      _prob_co[i][k] = norm_prob;
-      new_prob_c[i] += norm_prob * _prob_o;
+      prob += _prob_c_partials[palette_size*c+i];
     }
+    _prob_c[i] = prob;
   }
-  _prob_c.swap(new_prob_c);
+  invalidate_covariances();
 }
 
 Real AbstractionResampler::refine_palette()
 {
   INFO("refine_palette()");
 
-  std::vector<cv::Vec3d> color_sums(_palette.size(), cv::Vec3d(0.0, 0.0, 0.0));
+  _palette_sums.assign(_palette.size(), cv::Vec3d(0.0, 0.0, 0.0));
 
-  for ( SizeType k=0; k < _superpixels.size(); k++ )
+  for ( SizeType i=0; i < _palette.size(); i++ )
   {
-    for ( SizeType i=0; i < _palette.size(); i++ )
+    const Real * prob_co = &_prob_co[i*_n_superpixels];
+    for ( SizeType k=0; k < _n_superpixels; k++ )
     {
-      color_sums[i] += _superpixels[k].color * _prob_co[i][k] * _prob_o;
+      _palette_sums[i] += _sp_color[k] * prob_co[k] * _prob_o;
     }
   }
   Real palette_error(0);
-  for ( SizeType i=0; i < color_sums.size(); i++ )
+  for ( SizeType i=0; i < _palette_sums.size(); i++ )
   {
     ASSERT(_prob_c[i] > 0);
     cv::Vec3d color = _palette[i];
-    cv::Vec3d new_color = color_sums[i] / _prob_c[i];
+    cv::Vec3d new_color = _palette_sums[i] / _prob_c[i];
     palette_error += cv::norm(color, new_color);
     _palette[i] = new_color;
   }
+  invalidate_covariances();
 
   return palette_error;
 }
@@ -427,6 +795,7 @@ void AbstractionResampler::expand_palette()
     else
     {
       _palette[index_2] += get_max_eigen(index_1).first * 0.8;
+      invalidate_covariance(index_2);
     }
   }
 
@@ -455,18 +824,27 @@ void AbstractionResampler::split_color(SizeType index)
   const cv::Vec3f subcluster_color1 = color_1 + get_max_eigen(index_1).first * 0.8;
   const cv::Vec3f subcluster_color2 = color_2 + get_max_eigen(index_2).first * 0.8;
 
+  invalidate_covariance(index_1);
+  invalidate_covariance(index_2);
+
   _palette.push_back(subcluster_color1);
   _sub_superpixel_pairs[index].second = next_index1;
   _prob_c[index_1] *= 0.5;
   _prob_c.push_back(_prob_c[index_1]);
-  _prob_co.push_back(_prob_co[index_1]);
+  _prob_co.resize(_prob_co.size()+_n_superpixels);
+  std::copy(_prob_co.begin()+index_1*_n_superpixels,
+            _prob_co.begin()+(index_1+1)*_n_superpixels,
+            _prob_co.end()-_n_superpixels);
 
   _palette.push_back(subcluster_color2);
   const std::pair<SizeType, SizeType> new_pair(index_2, next_index2);
   _sub_superpixel_pairs.push_back(new_pair);
   _prob_c[index_2] *= 0.5;
   _prob_c.push_back(_prob_c[index_2]);
-  _prob_co.push_back(_prob_co[index_2]);
+  _prob_co.resize(_prob_co.size()+_n_superpixels);
+  std::copy(_prob_co.begin()+index_2*_n_superpixels,
+            _prob_co.begin()+(index_2+1)*_n_superpixels,
+            _prob_co.end()-_n_superpixels);
 }
 
 void AbstractionResampler::condense_palette()
@@ -476,7 +854,8 @@ void AbstractionResampler::condense_palette()
   _palette_maxed = true;
   std::vector<cv::Vec3f> old_palette = _palette;
   std::vector<cv::Vec3f> new_palette;
-  std::vector<std::vector<Real> > new_prob_co;
+  std::vector<Real> new_prob_co;
+  new_prob_co.reserve(_sub_superpixel_pairs.size()*_n_superpixels);
   std::vector<Real> new_prob_c;
   for ( SizeType j = 0; j < _sub_superpixel_pairs.size(); j++ )
   {
@@ -490,77 +869,114 @@ void AbstractionResampler::condense_palette()
     new_palette.push_back((old_palette[index_1] * weight_1) +
                           (old_palette[index_2] * weight_2));
     new_prob_c.push_back(_prob_c[index_1] + _prob_c[index_2]);
-    new_prob_co.push_back(_prob_co[index_1]);
+    new_prob_co.insert(new_prob_co.end(),
+                       _prob_co.begin()+index_1*_n_superpixels,
+                       _prob_co.begin()+(index_1+1)*_n_superpixels);
 
-    for ( SizeType k=0; k < _superpixels.size(); k++ )
+    for ( SizeType k=0; k < _n_superpixels; k++ )
     {
-      if ( _superpixels[k].assoc == index_1
-        || _superpixels[k].assoc == index_2 )
+      if ( _sp_assoc[k] == index_1 || _sp_assoc[k] == index_2 )
       {
-        _superpixels[k].assoc = j;
+        _sp_assoc[k] = j;
       }
     }
   }
   _palette.swap(new_palette);
   _prob_c.swap(new_prob_c);
   _prob_co.swap(new_prob_co);
+  invalidate_covariances();
 }
 
-Real AbstractionResampler::slic_distance(SizeType i, SizeType j, const cv::Vec2f & pos, const cv::Vec3f & spcolor) const
+void AbstractionResampler::update_covariances()
 {
-  Real dx = Real(i) - pos[0];
-  Real dy = Real(j) - pos[1];
-  cv::Vec3f color = _input_lab.at<cv::Vec3f>(j, i);
-  Real color_error = cv::norm(color, spcolor);
-  Real dist_error = cv::norm(cv::Vec2f(dx, dy));
-  return color_error + 45.0 / _range * dist_error;
+  // superpixels per work item, fixed so the reduction order is too
+  static const SizeType chunk_size = 256;
+
+  const SizeType palette_size = _palette.size();
+  const SizeType n_chunks = (_n_superpixels+chunk_size-1) / chunk_size;
+  _covariance_partials.assign(6*palette_size*n_chunks, 0.0);
+
+  // one pass over the superpixels accumulates the weighted covariance of
+  // the color errors of every palette entry at once
+  parallel_for(0, n_chunks, [&](SizeType c)
+  {
+    double * partial = &_covariance_partials[6*palette_size*c];
+    const SizeType k0 = c*chunk_size;
+    const SizeType k1 = std::min(k0+chunk_size, _n_superpixels);
+    for ( SizeType i=0; i < palette_size; i++, partial+=6 )
+    {
+      //get prob(output pixel|palette color)
+      const Real * prob_co = &_prob_co[i*_n_superpixels];
+      const Real scale = _prob_o / _prob_c[i];
+      const cv::Vec3d color = _palette[i];
+      for ( SizeType k=k0; k < k1; k++ )
+      {
+        const double prob_oc = prob_co[k] * scale;
+        const double e0 = std::abs(color[0] - _sp_color[k][0]);
+        const double e1 = std::abs(color[1] - _sp_color[k][1]);
+        const double e2 = std::abs(color[2] - _sp_color[k][2]);
+        partial[0] += prob_oc*e0*e0;
+        partial[1] += prob_oc*e0*e1;
+        partial[2] += prob_oc*e0*e2;
+        partial[3] += prob_oc*e1*e1;
+        partial[4] += prob_oc*e1*e2;
+        partial[5] += prob_oc*e2*e2;
+      }
+    }
+  });
+
+  _covariances.assign(6*palette_size, 0.0);
+  for ( SizeType c=0; c < n_chunks; c++ )
+  {
+    const double * partial = &_covariance_partials[6*palette_size*c];
+    for ( SizeType n=0; n < 6*palette_size; n++ )
+    {
+      _covariances[n] += partial[n];
+    }
+  }
+  _covariance_valid.assign(palette_size, 1);
+}
+
+void AbstractionResampler::invalidate_covariance(SizeType pidx)
+{
+  if ( pidx < _covariance_valid.size() )
+  {
+    _covariance_valid[pidx] = 0;
+  }
+}
+
+void AbstractionResampler::invalidate_covariances()
+{
+  _covariance_valid.clear();
 }
 
 std::pair<cv::Vec3f, Real> AbstractionResampler::get_max_eigen(SizeType pidx)
 {
-  //for every output pixel
-  cv::Mat matrix(cv::Size(3,3), CV_64FC1, cv::Scalar(0.0));
-  Real sum(0);
-  for ( SizeType y = 0; y < _output_height; y++ )
-    for ( SizeType x = 0; x < _output_width; x++ ) {
-      //get prob(output pixel|palette color)
-      Real prob_oc = _prob_co[pidx][x*_output_height+y] * _prob_o / _prob_c[pidx];
-      sum += prob_oc;
-      //construct 3x3 matrix and add to sum
-      cv::Vec3d color_error = _palette[pidx] - _superpixels[x*_output_height+y].color;
-      color_error[0] = std::abs(color_error[0]);
-      color_error[1] = std::abs(color_error[1]);
-      color_error[2] = std::abs(color_error[2]);
-      matrix.at<double>(0,0) += prob_oc*color_error[0]*color_error[0];
-      matrix.at<double>(1,0) += prob_oc*color_error[1]*color_error[0];
-      matrix.at<double>(2,0) += prob_oc*color_error[2]*color_error[0];
-      matrix.at<double>(0,1) += prob_oc*color_error[0]*color_error[1];
-      matrix.at<double>(1,1) += prob_oc*color_error[1]*color_error[1];
-      matrix.at<double>(2,1) += prob_oc*color_error[2]*color_error[1];
-      matrix.at<double>(0,2) += prob_oc*color_error[0]*color_error[2];
-      matrix.at<double>(1,2) += prob_oc*color_error[1]*color_error[2];
-      matrix.at<double>(2,2) += prob_oc*color_error[2]*color_error[2];
-    }
+  // palette entries do not depend on each other, so the cached covariance
+  // of an entry stays exact until that entry or the superpixels change
+  if ( pidx >= _covariance_valid.size() || !_covariance_valid[pidx] )
+  {
+    update_covariances();
+  }
 
   //get critical temperature = largest eigenvalue of convariance matrix
-  cv::Mat values;
-  cv::Mat vectors;
-  cv::eigen(matrix,values, vectors);
+  double value;
+  double vector[3];
+  symmetric_eigen3(&_covariances[6*pidx], value, vector);
 
-  cv::Vec3f eVec = cv::Vec3f(vectors.at<double>(0,0),
-    vectors.at<double>(0,1),
-    vectors.at<double>(0,2));
+  cv::Vec3f eVec = cv::Vec3f(vector[0], vector[1], vector[2]);
   float len = norm(eVec);
   if(len > 0)
     eVec *= (1.0/len);
-  float eVal = abs(values.at<double>(0,0));
+  float eVal = std::abs(value);
 
   return std::pair<cv::Vec3f, float>(eVec, eVal);
 }
 
-std::vector<cv::Vec3f> AbstractionResampler::get_averaged_palette()
+const std::vector<cv::Vec3f> & AbstractionResampler::get_averaged_palette()
 {
-  std::vector<cv::Vec3f> averaged_palette = _palette;
+  std::vector<cv::Vec3f> & averaged_palette = _averaged_palette;
+  averaged_palette.assign(_palette.begin(), _palette.end());
   if ( !_palette_maxed ) {
     for( SizeType i = 0; i< _sub_superpixel_pairs.size(); ++i )
     {
@@ -584,3 +1000,9 @@ std::vector<cv::Vec3f> AbstractionResampler::get_averaged_palette()
   }
   return averaged_palette;
 }
+
+// the tiled resampler streams float bands through the same row kernels
+template void AbstractionResampler::remap_row<float>(SizeType, const float *, const float *,
+    const float *, float *, LabelType *) const;
+template void AbstractionResampler::accumulate_row<float>(SizeType, SizeType, const float *,
+    const float *, const float *, const LabelType *);
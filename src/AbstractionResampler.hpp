@@ -9,86 +9,183 @@
 #define __ABSTRACTION_RESAMPLER_HPP__
 
 #include "Resampler.hpp"
+#include "ColorConversion.hpp"
 
+#include <array>
 #include <vector>
+#include <chrono>
 
 PRJ_BEGIN
 
 class AbstractionResampler : public Resampler {
 protected:
-  struct SuperPixel {
-    cv::Vec2f position; // normalized
+  typedef uint32_t LabelType; ///< superpixel or palette index
+
+  /// search window of a superpixel in input pixel coordinates
+  struct SearchWindow {
+    int x0, y0, x1, y1;
+    cv::Vec2f center;
     cv::Vec3f color;
-    SizeType  id;
-    SizeType  assoc;
-    SuperPixel(SizeType id)
-      : id(id), assoc(0)
+  };
+
+  /// partial sums over the pixels of a superpixel
+  struct Moments {
+    double x, y, L, a, b;
+    SizeType n;
+    Moments()
+      : x(0), y(0), L(0), a(0), b(0), n(0)
+    {}
+  };
+
+public:
+  /** when to stop iterating
+   *
+   * Whichever limit is hit first ends the iterations. A run that did
+   * not converge is finalized from the best refined state it saw: the
+   * one with the most palette colors and, among those, the smallest
+   * palette change, rather than from a palette just expanded.
+   */
+  struct ConvergencePolicy {
+    SizeType max_iterations; ///< 0 means unlimited
+    double time_budget;      ///< wall-clock seconds, 0 means unlimited
+    Real palette_error;      ///< palette change that counts as settled
+    ConvergencePolicy()
+      : max_iterations(101), time_budget(0), palette_error(1.0)
     {}
   };
 
 public:
   AbstractionResampler(SizeType nc)
-    : Resampler(nc)
+    : Resampler(nc), _pyramid_levels(0), _fixed_point_lab(false)
   {
   }
 
   virtual ~AbstractionResampler() {}
 
   virtual void resample(SizeType w, SizeType h);
+  void resample(SizeType w, SizeType h, const ConvergencePolicy & policy);
+
+  SizeType getIterations() const
+  {
+    return _iteration;
+  }
+
+  bool isConverged() const
+  {
+    return _converged;
+  }
+
+  /** run the early iterations on downsampled inputs
+   *
+   * Each level halves the input size. Iterations start on the coarsest
+   * level and move one level finer every time the palette grows, so
+   * only the final iterations see the full resolution.
+   */
+  void setPyramidLevels(SizeType levels)
+  {
+    _pyramid_levels = levels;
+  }
+
+  /** keep the Lab input as 16-bit fixed point instead of float
+   *
+   * Halves the memory the SLIC passes stream through on every iteration.
+   * The input is rounded to 1/256 per channel (delta E below 0.0034),
+   * everything computed from it stays in float.
+   */
+  void setFixedPointLab(bool enable)
+  {
+    _fixed_point_lab = enable;
+  }
+
+  /** use this palette as is instead of growing one
+   *
+   * Only the superpixels and their association to the palette are
+   * refined, and the output uses exactly these colors. An empty palette
+   * switches back to the regular mode.
+   */
+  void setFixedPalette(const std::vector<cv::Vec3b> & bgr)
+  {
+    _fixed_bgr = bgr;
+    _fixed_lab.resize(bgr.size());
+    if ( !bgr.empty() )
+    {
+      bgr_to_lab(&bgr[0], &_fixed_lab[0], bgr.size());
+    }
+  }
+
+  /// same as above with the palette given in Lab
+  void setFixedPaletteLab(const std::vector<cv::Vec3f> & lab)
+  {
+    _fixed_lab = lab;
+    _fixed_bgr.resize(lab.size());
+    if ( !lab.empty() )
+    {
+      lab_to_bgr(&lab[0], &_fixed_bgr[0], lab.size());
+    }
+  }
 
 protected:
   void initialize(const SizeType w, const SizeType h);
+  void initialize_fixed_palette();
+  virtual void prepare_input();
+  void set_level(SizeType level);
+  void set_input_size(SizeType w, SizeType h);
   bool is_done();
   void iterate();
+  void keep_best(Real error);
   void finalize();
 
 public:
-  void visualizeSuperpixel(cv::Mat & output);
+  /** superpixel overlay: palette colors, contours in red, centers in green
+   *
+   * With scale > 1 every scale-th pixel of the input is drawn, which is
+   * much cheaper for large images. If the run stopped on a coarse
+   * pyramid level, the first call maps the full resolution once.
+   */
+  virtual void visualizeSuperpixel(cv::Mat & output, SizeType scale=1);
 
 protected:
-  void remap_pixels();
-  void update_superpixels();
+  virtual void remap_pixels();
+  virtual void update_superpixels();
+  void prepare_search_windows();
+  /// L, a, b are float or fixed-point (int16_t) rows
+  template <typename T>
+  void remap_row(SizeType j, const T * L, const T * a, const T * b,
+                 float * dist, LabelType * label) const;
+  void stripe_bounds(SizeType s, SizeType & y0, SizeType & y1) const;
+  void clear_stripe(SizeType s);
+  template <typename T>
+  void accumulate_row(SizeType s, SizeType j, const T * L, const T * a,
+                      const T * b, const LabelType * label);
+  void resolve_superpixels();
+  virtual cv::Vec3f sample_input(SizeType x, SizeType y) const;
   void associate_superpixels();
   Real refine_palette();
   void expand_palette();
   void split_color(SizeType index);
   void condense_palette();
-  Real slic_distance(SizeType i, SizeType j, const cv::Vec2f & pos, const cv::Vec3f & spcolor) const;
+  void update_covariances();
+  void invalidate_covariance(SizeType pidx);
+  void invalidate_covariances();
   std::pair<cv::Vec3f, Real> get_max_eigen(SizeType pidx);
-  std::vector<cv::Vec3f> get_averaged_palette();
+  const std::vector<cv::Vec3f> & get_averaged_palette();
 
 public:
   static inline void bgr2lab(const cv::Mat & in, cv::Mat & out)
   {
-    // bgr2lab conversion includes two steps:
-    // 1. convert data type from CV_8UC3 to CV_32FC3 with scaling
-    // 2. convert color space from BGR to Lab
-    in.convertTo(out, CV_32FC3, 1./255);
-    cv::cvtColor(out, out, CV_BGR2Lab);
+    bgr_to_lab(in, out);
   }
   static inline void lab2bgr(const cv::Mat & in, cv::Mat & out)
   {
-    // lab2bgr conversion includes two steps:
-    // 1. convert color space from Lab to BGR
-    // 2. convert data type from CV_32FC3 to CV_8UC3 with scaling
-    cv::cvtColor(in, out, CV_Lab2BGR);
-    out.convertTo(out, CV_8UC3, 255.0);
+    lab_to_bgr(in, out);
   }
   static inline cv::Vec3b lab2bgr(const cv::Vec3f & lab)
   {
-    cv::Mat holder(cv::Size(1,1),CV_32FC3);
-    holder.at<cv::Vec3f>(0,0) = lab;
-    cv::Mat holder2;
-    lab2bgr(holder, holder2);
-    return holder2.at<cv::Vec3b>(0,0);
+    return lab_to_bgr(lab);
   }
   static inline cv::Vec3f bgr2lab(const cv::Vec3b & bgr)
   {
-    cv::Mat holder(cv::Size(1,1),CV_8UC3);
-    holder.at<cv::Vec3b>(0,0) = bgr;
-    cv::Mat holder2;
-    bgr2lab(holder, holder2);
-    return holder2.at<cv::Vec3f>(0,0);
+    return bgr_to_lab(bgr);
   }
 
 protected:
@@ -98,20 +195,57 @@ protected:
   SizeType _output_height;
   Real _input_area;
   Real _output_area;
-  cv::Mat _input_lab;
-  cv::Mat _output_lab;
+  std::vector<std::array<cv::Mat, 3> > _pyramid; ///< planar Lab input, full resolution first
+  SizeType _pyramid_levels;
+  SizeType _level;
+  bool _fixed_point_lab;
+  std::array<cv::Mat, 3> _lab_planes; ///< planar L, a, b of the current level, CV_32F or CV_16S
+  ConvergencePolicy _policy;
+  std::chrono::steady_clock::time_point _start_time;
+  double _iteration_seconds; ///< duration of the last iteration
   bool _converged;
   bool _palette_maxed;
   SizeType _iteration;
   Real _range;
-  std::vector<SuperPixel> _superpixels;
-  std::vector<std::vector<SizeType> > _pixel_map;
+  SizeType _n_superpixels;
+  // superpixels, row-major over the output grid
+  std::vector<cv::Vec2f> _sp_position; ///< normalized
+  std::vector<cv::Vec3f> _sp_color;
+  std::vector<LabelType> _sp_assoc;
+  // row-major over the input image
+  std::vector<LabelType> _pixel_map;
+  std::vector<float> _distance_map;
+  std::vector<SizeType> _cell_x; ///< first input column of each grid column
+  std::vector<SizeType> _cell_y; ///< first input row of each grid row
   std::vector<cv::Vec3f> _palette;
   Real _prob_o;
   std::vector<Real> _prob_c;
-  std::vector<std::vector<Real> > _prob_co;
+  std::vector<Real> _prob_co; ///< palette-by-superpixel, row i at i*_n_superpixels
   std::vector<std::pair<SizeType, SizeType> > _sub_superpixel_pairs;
   Real _temperature;
+  std::vector<cv::Vec3f> _fixed_lab; ///< prescribed palette, empty if none
+  std::vector<cv::Vec3b> _fixed_bgr;
+  // best refined state, finalized when the run stops before converging
+  std::vector<cv::Vec3f> _best_palette; ///< averaged, Lab
+  std::vector<LabelType> _best_assoc;
+  SizeType _best_colors;
+  Real _best_error;
+
+  // scratch buffers reused across iterations
+  std::vector<SearchWindow> _search_windows;
+  SizeType _n_stripes;
+  std::vector<SizeType> _stripe_offsets;
+  std::vector<Moments> _moments; ///< per-stripe partial sums
+  std::vector<cv::Vec2f> _smoothed_position;
+  cv::Mat _smoothed_color;
+  std::vector<cv::Vec3f> _averaged_palette;
+  std::vector<float> _palette_planes;
+  std::vector<float> _assoc_scratch;
+  std::vector<double> _prob_c_partials;
+  std::vector<double> _covariances; ///< upper triangles, 6 per palette entry
+  std::vector<double> _covariance_partials;
+  std::vector<char> _covariance_valid;
+  std::vector<cv::Vec3d> _palette_sums;
 
 };
 
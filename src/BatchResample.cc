@@ -0,0 +1,365 @@
+/**
+ * Headless batch resampling.
+ *
+ *   BatchResample <directory|manifest> <output directory> [options]
+ *
+ *   -m <method>   nearest, bilinear, bicubic, lanczos or abstraction
+ *   -s <W>x<H>    output size
+ *   -f <factor>   output size as input size / factor (default 12)
+ *   -c <colors>   palette size, 0 keeps all colors (default 8)
+ *   -j <threads>  resample workers (default: hardware threads)
+ *   -q <bits>     quantize over a histogram with bits per channel
+ *   -Q <name>     quantizer: mediancut, histogram, kmeans, octree or uniform
+ *   -p <image>    map every output to the colors of this palette image
+ *
+ * A manifest is a text file with one image path per line. Decoding,
+ * resampling and encoding run as separate stages connected by bounded
+ * queues, so disk and codec time overlaps with the resampling.
+ */
+#include "NearestResampler.hpp"
+#include "BilinearResampler.hpp"
+#include "BicubicResampler.hpp"
+#include "LanczosResampler.hpp"
+#include "AbstractionResampler.hpp"
+#include "BoundedQueue.hpp"
+
+#include <set>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <opencv2/opencv.hpp>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+USE_PRJ_NAMESPACE;
+
+/// one image on its way through the pipeline
+struct Job {
+  std::string name;
+  cv::Mat image;
+};
+
+struct Options {
+  std::string method;
+  std::string palette;
+  std::string quantizer;
+  SizeType width, height, factor, colors, threads, histogram_bits;
+  Options()
+    : method("nearest"), width(0), height(0), factor(12), colors(8),
+      threads(std::max(1u, std::thread::hardware_concurrency())), histogram_bits(0)
+  {}
+};
+
+static Resampler * create_resampler(const std::string & method, SizeType colors)
+{
+  if ( method == "nearest" ) return new NearestResampler(colors);
+  if ( method == "bilinear" ) return new BilinearResampler(colors);
+  if ( method == "bicubic" ) return new BicubicResampler(colors);
+  if ( method == "lanczos" ) return new LanczosResampler(colors);
+  if ( method == "abstraction" ) return new AbstractionResampler(colors);
+  return NULL;
+}
+
+/// one quantizer for every worker, NULL for the resampler default
+static std::shared_ptr<const Quantizer> create_quantizer(const std::string & name, SizeType bits)
+{
+  if ( name == "mediancut" ) return std::make_shared<MedianCutQuantizer>();
+  if ( name == "histogram" ) return std::make_shared<HistogramQuantizer>(bits);
+  if ( name == "kmeans" ) return std::make_shared<KMeansQuantizer>(bits);
+  if ( name == "octree" ) return std::make_shared<OctreeQuantizer>();
+  if ( name == "uniform" ) return std::make_shared<UniformQuantizer>();
+  return std::shared_ptr<const Quantizer>();
+}
+
+static bool has_image_extension(const std::string & name)
+{
+  static const char * extensions[] = {".png", ".jpg", ".jpeg", ".bmp", ".ppm", ".tif", ".tiff"};
+  const std::string::size_type dot = name.rfind('.');
+  if ( dot == std::string::npos ) return false;
+  std::string ext = name.substr(dot);
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  for ( SizeType i=0; i < sizeof(extensions)/sizeof(extensions[0]); i++ )
+  {
+    if ( ext == extensions[i] ) return true;
+  }
+  return false;
+}
+
+/// image paths of a directory (sorted) or listed in a manifest
+static bool list_inputs(const std::string & path, std::vector<std::string> & files)
+{
+  struct stat st;
+  if ( stat(path.c_str(), &st) != 0 ) return false;
+  if ( S_ISDIR(st.st_mode) )
+  {
+    DIR * dir = opendir(path.c_str());
+    if ( !dir ) return false;
+    while ( struct dirent * entry = readdir(dir) )
+    {
+      if ( has_image_extension(entry->d_name) )
+      {
+        files.push_back(path + "/" + entry->d_name);
+      }
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+  }
+  else
+  {
+    std::ifstream manifest(path.c_str());
+    std::string line;
+    while ( std::getline(manifest, line) )
+    {
+      if ( !line.empty() && line[0] != '#' ) files.push_back(line);
+    }
+  }
+  return true;
+}
+
+static std::string base_name(const std::string & path)
+{
+  const std::string::size_type slash = path.rfind('/');
+  return slash == std::string::npos ? path : path.substr(slash+1);
+}
+
+/// output names by base name, with -2, -3, ... before the extension on repeats
+static void output_names(const std::vector<std::string> & files, std::vector<std::string> & names)
+{
+  std::set<std::string> used;
+  names.resize(files.size());
+  for ( SizeType i=0; i < files.size(); i++ )
+  {
+    const std::string name = base_name(files[i]);
+    const std::string::size_type dot = name.rfind('.');
+    const std::string stem = name.substr(0, dot), ext = dot == std::string::npos ? "" : name.substr(dot);
+    names[i] = name;
+    for ( SizeType k=2; !used.insert(names[i]).second; k++ )
+    {
+      names[i] = stem + "-" + std::to_string(k) + ext;
+    }
+    if ( names[i] != name )
+    {
+      WARN("%s is written as %s", files[i].c_str(), names[i].c_str());
+    }
+  }
+}
+
+/// runs n copies of body and calls finish once after the last one
+template <typename Body, typename Finish>
+static void run_stage(std::vector<std::thread> & threads, SizeType n, Body body, Finish finish)
+{
+  std::shared_ptr<std::atomic<SizeType> > alive(new std::atomic<SizeType>(n));
+  for ( SizeType t=0; t < n; t++ )
+  {
+    threads.push_back(std::thread([=]()
+    {
+      body();
+      if ( --*alive == 0 ) finish();
+    }));
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  if ( argc < 3 )
+  {
+    INFO("Usage: %s <directory|manifest> <output directory> "
+         "[-m method] [-s WxH | -f factor] [-c colors] [-j threads] [-q bits] [-Q quantizer] [-p palette]", argv[0]);
+    return -1;
+  }
+
+  Options opt;
+  for ( int i=3; i < argc; i+=2 )
+  {
+    const std::string flag = argv[i];
+    if ( i+1 == argc )
+    {
+      WARN("option %s needs a value", flag.c_str());
+      return -1;
+    }
+    const char * value = argv[i+1];
+    if ( flag == "-m" ) opt.method = value;
+    else if ( flag == "-s" )
+    {
+      char rest;
+      if ( sscanf(value, "%lux%lu%c", &opt.width, &opt.height, &rest) != 2 ||
+           !opt.width || !opt.height )
+      {
+        WARN("invalid size %s, expected WxH", value);
+        return -1;
+      }
+    }
+    else if ( flag == "-f" ) opt.factor = std::max(1, atoi(value));
+    else if ( flag == "-c" )
+    {
+      const int colors = atoi(value);
+      if ( colors < 0 )
+      {
+        WARN("invalid palette size %s", value);
+        return -1;
+      }
+      opt.colors = colors;
+    }
+    else if ( flag == "-j" ) opt.threads = std::max(1, atoi(value));
+    else if ( flag == "-p" ) opt.palette = value;
+    else if ( flag == "-q" ) opt.histogram_bits = std::min(max_histogram_bits, std::max(1, atoi(value)));
+    else if ( flag == "-Q" ) opt.quantizer = value;
+    else
+    {
+      WARN("unknown option %s", flag.c_str());
+      return -1;
+    }
+  }
+  // checked here since every worker creates its own resampler
+  std::unique_ptr<Resampler> probe(create_resampler(opt.method, opt.colors));
+  if ( !probe )
+  {
+    WARN("unknown method %s", opt.method.c_str());
+    return -1;
+  }
+  if ( opt.quantizer.empty() && opt.histogram_bits ) opt.quantizer = "histogram";
+  std::shared_ptr<const Quantizer> quantizer;
+  if ( !opt.quantizer.empty() )
+  {
+    quantizer = create_quantizer(opt.quantizer, opt.histogram_bits ? opt.histogram_bits : 5);
+    if ( !quantizer )
+    {
+      WARN("unknown quantizer %s", opt.quantizer.c_str());
+      return -1;
+    }
+  }
+
+  // the distinct colors of the palette image, in scan order
+  std::vector<cv::Vec3b> palette;
+  std::shared_ptr<PaletteMapper> mapper;
+  if ( !opt.palette.empty() )
+  {
+    const cv::Mat image = cv::imread(opt.palette, CV_LOAD_IMAGE_COLOR);
+    if ( !image.data )
+    {
+      WARN("cannot read palette %s", opt.palette.c_str());
+      return -1;
+    }
+    for ( int j=0; j < image.rows; j++ )
+      for ( int i=0; i < image.cols; i++ )
+      {
+        const cv::Vec3b & c = image.at<cv::Vec3b>(j, i);
+        if ( std::find(palette.begin(), palette.end(), c) == palette.end() )
+        {
+          palette.push_back(c);
+        }
+      }
+    if ( palette.size() > 65536 )
+    {
+      WARN("too many palette colors in %s", opt.palette.c_str());
+      return -1;
+    }
+    mapper = std::make_shared<PaletteMapper>();
+    mapper->build(palette);
+  }
+
+  std::vector<std::string> files;
+  if ( !list_inputs(argv[1], files) )
+  {
+    WARN("cannot read %s", argv[1]);
+    return -1;
+  }
+  std::vector<std::string> names;
+  output_names(files, names);
+  const std::string output_dir = argv[2];
+  INFO("%lu images, method %s, %lu workers", SizeType(files.size()),
+       opt.method.c_str(), opt.threads);
+
+  // The workers already keep every core busy, so the resamplers must not
+  // fan out onto OpenCV's pool as well. Codec stages are mostly I/O bound
+  // and get a quarter of the threads each.
+  cv::setNumThreads(1);
+  const SizeType io_threads = std::max(SizeType(1), opt.threads/4);
+  BoundedQueue<Job> decoded(2*opt.threads);
+  BoundedQueue<Job> resampled(2*opt.threads);
+  std::atomic<SizeType> next_file(0), n_done(0), n_failed(0);
+  std::vector<std::thread> threads;
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  run_stage(threads, io_threads, [&]()
+  {
+    for ( SizeType i=next_file++; i < files.size(); i=next_file++ )
+    {
+      Job job;
+      job.name = names[i];
+      job.image = cv::imread(files[i], CV_LOAD_IMAGE_COLOR);
+      if ( !job.image.data )
+      {
+        WARN("cannot decode %s", files[i].c_str());
+        n_failed++;
+        continue;
+      }
+      decoded.push(std::move(job));
+    }
+  }, [&]() { decoded.close(); });
+
+  run_stage(threads, opt.threads, [&]()
+  {
+    std::unique_ptr<Resampler> resampler(create_resampler(opt.method, opt.colors));
+    if ( quantizer )
+    {
+      resampler->setQuantizer(quantizer);
+    }
+    resampler->setPalette(mapper);
+    AbstractionResampler * abstraction = dynamic_cast<AbstractionResampler *>(resampler.get());
+    if ( abstraction )
+    {
+      abstraction->setFixedPalette(palette);
+    }
+    Job job;
+    while ( decoded.pop(job) )
+    {
+      SizeType w = opt.width, h = opt.height;
+      if ( !w || !h )
+      {
+        w = std::max(1, job.image.cols / int(opt.factor));
+        h = std::max(1, job.image.rows / int(opt.factor));
+      }
+      resampler->load(std::move(job.image));
+      resampler->resampleTo(w, h, job.image);
+      resampled.push(std::move(job));
+    }
+  }, [&]() { resampled.close(); });
+
+  run_stage(threads, io_threads, [&]()
+  {
+    Job job;
+    while ( resampled.pop(job) )
+    {
+      const std::string path = output_dir + "/" + job.name;
+      if ( cv::imwrite(path, job.image) )
+      {
+        n_done++;
+      }
+      else
+      {
+        WARN("cannot encode %s", path.c_str());
+        n_failed++;
+      }
+    }
+  }, []() {});
+
+  for ( SizeType t=0; t < threads.size(); t++ )
+  {
+    threads[t].join();
+  }
+
+  const double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  INFO("%lu images in %.3fs, %.2f images/s, %lu failed", SizeType(n_done),
+       seconds, n_done / std::max(seconds, 1e-9), SizeType(n_failed));
+
+  return n_failed ? 1 : 0;
+}
@@ -0,0 +1,69 @@
+#ifndef __BOUNDED_QUEUE_HPP__
+#define __BOUNDED_QUEUE_HPP__
+
+#include "Config.hpp"
+
+#include <deque>
+#include <utility>
+#include <mutex>
+#include <condition_variable>
+
+PRJ_BEGIN
+
+/** blocking FIFO with a fixed capacity, connecting two pipeline stages
+ *
+ * Producers block while the queue is full, which bounds the number of
+ * images in flight. Once closed, pops drain what is left and then fail.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+  BoundedQueue(SizeType capacity)
+    : _capacity(capacity), _closed(false)
+  {
+  }
+
+  /// false if the queue was closed and the item dropped
+  bool push(T && item)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _not_full.wait(lock, [this]{ return _closed || _items.size() < _capacity; });
+    if ( _closed ) return false;
+    _items.push_back(std::move(item));
+    _not_empty.notify_one();
+    return true;
+  }
+
+  /// false once the queue is closed and empty
+  bool pop(T & item)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _not_empty.wait(lock, [this]{ return _closed || !_items.empty(); });
+    if ( _items.empty() ) return false;
+    item = std::move(_items.front());
+    _items.pop_front();
+    _not_full.notify_one();
+    return true;
+  }
+
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _closed = true;
+    _not_full.notify_all();
+    _not_empty.notify_all();
+  }
+
+protected:
+  SizeType _capacity;
+  bool _closed;
+  std::deque<T> _items;
+  std::mutex _mutex;
+  std::condition_variable _not_full;
+  std::condition_variable _not_empty;
+
+};
+
+PRJ_END
+
+#endif //__BOUNDED_QUEUE_HPP__
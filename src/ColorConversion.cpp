@@ -0,0 +1,272 @@
+#include "ColorConversion.hpp"
+#include "Parallel.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+USE_PRJ_NAMESPACE;
+
+namespace {
+
+// the constants of OpenCV's float Lab conversion
+const float lab_threshold = 0.008856f;
+const float lab_slope = 7.787f;
+const float lab_offset = 16.0f / 116.0f;
+const float lab_kappa = 903.3f;
+const float lab_l_threshold = lab_threshold * lab_kappa;
+const float lab_f_threshold = lab_slope * lab_threshold + lab_offset;
+const float white_x = 0.950456f;
+const float white_z = 1.088754f;
+
+/// sRGB to XYZ with the white point divided out of X and Z
+const float rgb_to_xyz[9] = {
+  0.412453f/white_x, 0.357580f/white_x, 0.180423f/white_x,
+  0.212671f,         0.715160f,         0.072169f,
+  0.019334f/white_z, 0.119193f/white_z, 0.950227f/white_z
+};
+
+const float xyz_to_rgb[9] = {
+   3.240479f, -1.53715f,  -0.498535f,
+  -0.969256f,  1.875991f,  0.041556f,
+   0.055648f, -0.204043f,  1.057311f
+};
+
+/// cells of the coarse table in front of the exact decision levels
+const int coarse_cells = 4096;
+
+/// pixels converted per step of the interleaved paths
+const SizeType chunk_pixels = 256;
+
+struct Tables {
+  float linear[256];               ///< 8-bit sRGB to linear
+  float levels[256];               ///< linear value where k+1 begins
+  uint8_t coarse[coarse_cells+1];  ///< output at the start of a cell
+
+  Tables()
+  {
+    for ( int k=0; k < 256; k++ )
+    {
+      linear[k] = float(decode(k/255.0));
+      levels[k] = k < 255 ? float(decode((k+0.5)/255.0)) : 2.0f;
+    }
+    int k = 0;
+    for ( int c=0; c <= coarse_cells; c++ )
+    {
+      const float v = float(c) / coarse_cells;
+      while ( k < 255 && v >= levels[k] ) k++;
+      coarse[c] = uint8_t(k);
+    }
+  }
+
+  static double decode(double e)
+  {
+    return e <= 0.04045 ? e/12.92 : std::pow((e+0.055)/1.055, 2.4);
+  }
+
+  /// 8-bit sRGB of a linear value
+  uint8_t encode(float v) const
+  {
+    v = v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f;
+    int k = coarse[int(v*coarse_cells)];
+    while ( k < 255 && v >= levels[k] ) k++;
+    return uint8_t(k);
+  }
+};
+
+const Tables & tables()
+{
+  static const Tables t;
+  return t;
+}
+
+/// cube root for t > lab_threshold, the SSE2 version takes the same steps
+inline float lab_cbrt(float t)
+{
+  int32_t i;
+  std::memcpy(&i, &t, sizeof(i));
+  i = int32_t(float(i) * (1.0f/3)) + 709921077;
+  float y;
+  std::memcpy(&y, &i, sizeof(y));
+  for ( int k=0; k < 3; k++ )
+  {
+    y = (y + y + t/(y*y)) * (1.0f/3);
+  }
+  return y;
+}
+
+inline float lab_f(float t)
+{
+  return t > lab_threshold ? lab_cbrt(t) : lab_slope*t + lab_offset;
+}
+
+#if defined(__SSE2__)
+inline __m128 lab_f(__m128 t)
+{
+  const __m128 threshold = _mm_set1_ps(lab_threshold);
+  const __m128 third = _mm_set1_ps(1.0f/3);
+  const __m128 c = _mm_max_ps(t, threshold);
+  const __m128i guess = _mm_add_epi32(
+      _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_castps_si128(c)), third)),
+      _mm_set1_epi32(709921077));
+  __m128 y = _mm_castsi128_ps(guess);
+  for ( int k=0; k < 3; k++ )
+  {
+    y = _mm_mul_ps(_mm_add_ps(_mm_add_ps(y, y), _mm_div_ps(c, _mm_mul_ps(y, y))), third);
+  }
+  const __m128 linear = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(lab_slope), t), _mm_set1_ps(lab_offset));
+  const __m128 above = _mm_cmpgt_ps(t, threshold);
+  return _mm_or_ps(_mm_and_ps(above, y), _mm_andnot_ps(above, linear));
+}
+#endif
+
+/// n BGR pixels to planar L, a, b
+void bgr_to_lab_row(const unsigned char * in, float * L, float * A, float * B, SizeType n)
+{
+  const float * lin = tables().linear;
+  const float * m = rgb_to_xyz;
+  SizeType i = 0;
+#if defined(__SSE2__)
+  for ( ; i+4 <= n; i+=4 )
+  {
+    const unsigned char * p = in + 3*i;
+    const __m128 b = _mm_setr_ps(lin[p[0]], lin[p[3]], lin[p[6]], lin[p[9]]);
+    const __m128 g = _mm_setr_ps(lin[p[1]], lin[p[4]], lin[p[7]], lin[p[10]]);
+    const __m128 r = _mm_setr_ps(lin[p[2]], lin[p[5]], lin[p[8]], lin[p[11]]);
+    const __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(m[0])),
+        _mm_mul_ps(g, _mm_set1_ps(m[1]))), _mm_mul_ps(b, _mm_set1_ps(m[2])));
+    const __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(m[3])),
+        _mm_mul_ps(g, _mm_set1_ps(m[4]))), _mm_mul_ps(b, _mm_set1_ps(m[5])));
+    const __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(m[6])),
+        _mm_mul_ps(g, _mm_set1_ps(m[7]))), _mm_mul_ps(b, _mm_set1_ps(m[8])));
+    const __m128 fx = lab_f(x);
+    const __m128 fy = lab_f(y);
+    const __m128 fz = lab_f(z);
+    const __m128 above = _mm_cmpgt_ps(y, _mm_set1_ps(lab_threshold));
+    const __m128 l = _mm_or_ps(
+        _mm_and_ps(above, _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(116.0f), fy), _mm_set1_ps(16.0f))),
+        _mm_andnot_ps(above, _mm_mul_ps(_mm_set1_ps(lab_kappa), y)));
+    _mm_storeu_ps(L+i, l);
+    _mm_storeu_ps(A+i, _mm_mul_ps(_mm_set1_ps(500.0f), _mm_sub_ps(fx, fy)));
+    _mm_storeu_ps(B+i, _mm_mul_ps(_mm_set1_ps(200.0f), _mm_sub_ps(fy, fz)));
+  }
+#endif
+  for ( ; i < n; i++ )
+  {
+    const unsigned char * p = in + 3*i;
+    const float b = lin[p[0]], g = lin[p[1]], r = lin[p[2]];
+    const float x = r*m[0] + g*m[1] + b*m[2];
+    const float y = r*m[3] + g*m[4] + b*m[5];
+    const float z = r*m[6] + g*m[7] + b*m[8];
+    const float fx = lab_f(x), fy = lab_f(y), fz = lab_f(z);
+    L[i] = y > lab_threshold ? 116.0f*fy - 16.0f : lab_kappa*y;
+    A[i] = 500.0f*(fx - fy);
+    B[i] = 200.0f*(fy - fz);
+  }
+}
+
+/// n BGR pixels to interleaved Lab, through planes on the stack
+void bgr_to_lab_interleaved(const unsigned char * in, float * out, SizeType n)
+{
+  float L[chunk_pixels], A[chunk_pixels], B[chunk_pixels];
+  for ( SizeType i0=0; i0 < n; i0+=chunk_pixels )
+  {
+    const SizeType m = std::min(chunk_pixels, n-i0);
+    bgr_to_lab_row(in + 3*i0, L, A, B, m);
+    float * q = out + 3*i0;
+    for ( SizeType i=0; i < m; i++ )
+    {
+      q[3*i+0] = L[i];
+      q[3*i+1] = A[i];
+      q[3*i+2] = B[i];
+    }
+  }
+}
+
+inline float lab_f_inverse(float f)
+{
+  return f <= lab_f_threshold ? (f - lab_offset) / lab_slope : f*f*f;
+}
+
+/// n interleaved Lab pixels to BGR
+void lab_to_bgr_row(const float * in, unsigned char * out, SizeType n)
+{
+  const Tables & t = tables();
+  const float * m = xyz_to_rgb;
+  for ( SizeType i=0; i < n; i++ )
+  {
+    const float * p = in + 3*i;
+    float y, fy;
+    if ( p[0] <= lab_l_threshold )
+    {
+      y = p[0] / lab_kappa;
+      fy = lab_slope*y + lab_offset;
+    }
+    else
+    {
+      fy = (p[0] + 16.0f) / 116.0f;
+      y = fy*fy*fy;
+    }
+    const float x = lab_f_inverse(fy + p[1]/500.0f) * white_x;
+    const float z = lab_f_inverse(fy - p[2]/200.0f) * white_z;
+    unsigned char * q = out + 3*i;
+    q[2] = t.encode(m[0]*x + m[1]*y + m[2]*z);
+    q[1] = t.encode(m[3]*x + m[4]*y + m[5]*z);
+    q[0] = t.encode(m[6]*x + m[7]*y + m[8]*z);
+  }
+}
+
+}
+
+PRJ_BEGIN
+
+void bgr_to_lab(const cv::Mat & bgr, cv::Mat & lab)
+{
+  ASSERT(bgr.type() == CV_8UC3);
+  const cv::Mat in = bgr;
+  lab.create(in.size(), CV_32FC3);
+  parallel_for(0, SizeType(in.rows), [&](SizeType j)
+  {
+    bgr_to_lab_interleaved(in.ptr<unsigned char>(int(j)), lab.ptr<float>(int(j)), in.cols);
+  });
+}
+
+void bgr_to_lab_planes(const cv::Mat & bgr, cv::Mat & L, cv::Mat & a, cv::Mat & b)
+{
+  ASSERT(bgr.type() == CV_8UC3);
+  L.create(bgr.size(), CV_32FC1);
+  a.create(bgr.size(), CV_32FC1);
+  b.create(bgr.size(), CV_32FC1);
+  parallel_for(0, SizeType(bgr.rows), [&](SizeType j)
+  {
+    bgr_to_lab_row(bgr.ptr<unsigned char>(int(j)), L.ptr<float>(int(j)),
+                   a.ptr<float>(int(j)), b.ptr<float>(int(j)), bgr.cols);
+  });
+}
+
+void lab_to_bgr(const cv::Mat & lab, cv::Mat & bgr)
+{
+  ASSERT(lab.type() == CV_32FC3);
+  const cv::Mat in = lab;
+  bgr.create(in.size(), CV_8UC3);
+  parallel_for(0, SizeType(in.rows), [&](SizeType j)
+  {
+    lab_to_bgr_row(in.ptr<float>(int(j)), bgr.ptr<unsigned char>(int(j)), in.cols);
+  });
+}
+
+void bgr_to_lab(const cv::Vec3b * bgr, cv::Vec3f * lab, SizeType n)
+{
+  bgr_to_lab_interleaved(&bgr[0][0], &lab[0][0], n);
+}
+
+void lab_to_bgr(const cv::Vec3f * lab, cv::Vec3b * bgr, SizeType n)
+{
+  lab_to_bgr_row(&lab[0][0], &bgr[0][0], n);
+}
+
+PRJ_END
@@ -0,0 +1,50 @@
+#ifndef __COLOR_CONVERSION_HPP__
+#define __COLOR_CONVERSION_HPP__
+
+#include "Config.hpp"
+
+#include <opencv2/opencv.hpp>
+
+PRJ_BEGIN
+
+/** 8-bit sRGB (BGR order) to and from CIE Lab
+ *
+ * The conventions are those of cvtColor(CV_BGR2Lab) on float input in
+ * [0,1]: D65 white, L in [0,100]. Input gamma is a 256 entry table and
+ * the cube root is three Newton steps, evaluated 4 pixels at a time with
+ * SSE2; the scalar path takes the very same steps, so a single color
+ * and the same color inside an image convert to identical values.
+ * Output is encoded against exact 8-bit decision levels, without a
+ * float BGR image in between.
+ */
+
+/// CV_8UC3 to CV_32FC3
+void bgr_to_lab(const cv::Mat & bgr, cv::Mat & lab);
+
+/// CV_8UC3 to three CV_32FC1 planes, in one pass
+void bgr_to_lab_planes(const cv::Mat & bgr, cv::Mat & L, cv::Mat & a, cv::Mat & b);
+
+/// CV_32FC3 to CV_8UC3, an 8-bit bgr of the right size keeps its buffer
+void lab_to_bgr(const cv::Mat & lab, cv::Mat & bgr);
+
+/// n colors at once, e.g. a palette, without allocating
+void bgr_to_lab(const cv::Vec3b * bgr, cv::Vec3f * lab, SizeType n);
+void lab_to_bgr(const cv::Vec3f * lab, cv::Vec3b * bgr, SizeType n);
+
+inline cv::Vec3f bgr_to_lab(const cv::Vec3b & bgr)
+{
+  cv::Vec3f lab;
+  bgr_to_lab(&bgr, &lab, 1);
+  return lab;
+}
+
+inline cv::Vec3b lab_to_bgr(const cv::Vec3f & lab)
+{
+  cv::Vec3b bgr;
+  lab_to_bgr(&lab, &bgr, 1);
+  return bgr;
+}
+
+PRJ_END
+
+#endif //__COLOR_CONVERSION_HPP__
@@ -4,29 +4,45 @@
 #include "Config.hpp"
 
 #include <vector>
-#include <map>
+#include <limits>
 #include <algorithm>
+#include <functional>
 
 PRJ_BEGIN
 
-template <typename T>
+/** median cut quantizer
+ *
+ * The result is a dense palette of at most nClusters colors plus one
+ * label per input element, so LabelType only needs to hold nClusters-1.
+ */
+template <typename T, typename LabelType=uint16_t>
 class MedianCut {
 protected:
+  /// a contiguous range [begin, end) of the shared index array
   struct Cluster {
-    const std::vector<T> * data;
-    std::vector<SizeType> indices;
+    SizeType begin;
+    SizeType end;
+    T minimum; ///< per-component lower corner of the bounding box
+    T maximum; ///< per-component upper corner of the bounding box
+    SizeType split_component; ///< the longest side of the box
+    SizeType node; ///< index in the split tree
 
-    Cluster(const std::vector<T> * data, const std::vector<SizeType> & indices=std::vector<SizeType>())
-      : data(data), indices(indices)
+    Cluster(SizeType begin=0, SizeType end=0)
+      : begin(begin), end(end), split_component(0), node(0)
     {
     }
 
+    SizeType size() const
+    {
+      return end-begin;
+    }
+
     bool operator>(const Cluster & other) const
     {
 #define USE_LENGTH_TRICK
 #ifndef USE_LENGTH_TRICK
-      SizeType s1 = this->indices.size();
-      SizeType s2 = other.indices.size();
+      SizeType s1 = this->size();
+      SizeType s2 = other.size();
       if ( s1 > s2 )
       {
         return true;
@@ -36,34 +52,13 @@ protected:
 #else
     // TODO: redesign to have more flexibility on the
     // method of cluster comparison of specific type T
-      const SizeType i1 = this->getMaxLenIndex();
-      const SizeType i2 = other.getMaxLenIndex();
-      const T & t1 = this->getMinimum(i1);
-      const T & t2 = this->getMaximum(i1);
-      const T & t3 = other.getMinimum(i2);
-      const T & t4 = other.getMaximum(i2);
-      if ( t2[i1]-t1[i1] > t4[i2]-t3[i2] )
-      {
-        return true;
-      }
-      return false;
+      return this->getLength(this->split_component) >
+             other.getLength(other.split_component);
     }
 
     SizeType getMaxLenIndex() const
     {
-      SizeType max_index = 0;
-      for ( SizeType i=1; i < 3; i++ )
-      {
-        const T & t1 = getMinimum(i);
-        const T & t2 = getMaximum(i);
-        const T & m1 = getMinimum(max_index);
-        const T & m2 = getMaximum(max_index);
-        if ( t2[i]-t1[i] > m2[max_index]-m1[max_index] )
-        {
-          max_index = i;
-        }
-      }
-      return max_index;
+      return split_component;
     }
 #endif
 
@@ -72,44 +67,31 @@ protected:
       return other>(*this);
     }
 
-    const T & getMinimum(SizeType component) const
+    /// extent of the bounding box along one component
+    double getLength(SizeType component) const
     {
-      SizeType idx = 0;
-      const T * minimum = &(*data)[indices[0]];
-      for ( SizeType i=1; i < indices.size(); i++ )
-      {
-        const T * t = &(*data)[indices[i]];
-        if ( (*minimum)[component] > (*t)[component] )
-        {
-          idx = i;
-          minimum = t;
-        }
-      }
-      return (*minimum);
+      return double(maximum[component]) - double(minimum[component]);
     }
 
-    const T & getMaximum(SizeType component) const
+    /// the box corner, whose given component is the cluster minimum
+    const T & getMinimum(SizeType /*component*/) const
     {
-      SizeType idx = 0;
-      const T * maximum = &(*data)[indices[0]];
-      for ( SizeType i=1; i < indices.size(); i++ )
-      {
-        const T * t = &(*data)[indices[i]];
-        if ( (*maximum)[component] < (*t)[component] )
-        {
-          idx = i;
-          maximum = t;
-        }
-      }
-      return (*maximum);
+      return minimum;
+    }
+
+    /// the box corner, whose given component is the cluster maximum
+    const T & getMaximum(SizeType /*component*/) const
+    {
+      return maximum;
     }
 
   };
 
 public:
   MedianCut(SizeType nClusters)
-    : _nClusters(nClusters)
+    : _nClusters(nClusters), _max_tasks(1), _data(NULL), _weights(NULL)
   {
+    ASSERT(nClusters <= SizeType(std::numeric_limits<LabelType>::max())+1);
 #if 0
     // the number of clusters should be power of 2.
     // if not, promote it to be power of 2.
@@ -123,39 +105,107 @@ public:
   }
   virtual ~MedianCut() {}
 
-  inline T & getResult(const SizeType & index)
+  /** split up to max_tasks large clusters at a time
+   *
+   * Besides the cluster the serial order splits next, the largest other
+   * clusters are split ahead of time, concurrently. The serial heap order
+   * then just picks up the finished splits, so the result is identical
+   * to max_tasks = 1 (the default).
+   */
+  void setParallelSplits(SizeType max_tasks)
+  {
+    _max_tasks = std::max(SizeType(1), max_tasks);
+  }
+
+  inline const T & getResult(const SizeType & index) const
+  {
+    return _palette[_labels[index]];
+  }
+
+  /// one color per cluster
+  const std::vector<T> & getPalette() const
+  {
+    return _palette;
+  }
+
+  /// palette index of every input element
+  const std::vector<LabelType> & getLabels() const
   {
-    return _results[index];
+    return _labels;
   }
 
   void process(const std::vector<T> & data)
+  {
+    _weights = NULL;
+    run(data);
+  }
+
+  /** cluster elements that each stand for weights[i] samples
+   *
+   * Medians and cluster colors are weighted, e.g. by histogram counts.
+   */
+  void process(const std::vector<T> & data, const std::vector<SizeType> & weights)
+  {
+    ASSERT(weights.size() == data.size());
+    _weights = &weights;
+    run(data);
+  }
+
+  /** find median of t[l, r)
+   *
+   * for odd list, it picks the middle one
+   * for even list, it prefers the right middle one
+   */
+  template <typename TT>
+  static TT findMedian(const std::vector<TT> & t, SizeType l, SizeType r)
+  {
+    std::vector<TT> range(t.begin()+l, t.begin()+r);
+    const typename std::vector<TT>::iterator middle = range.begin() + range.size()/2;
+    std::nth_element(range.begin(), middle, range.end());
+    return *middle;
+  }
+
+protected:
+  void run(const std::vector<T> & data)
   {
     // set data
     _data = &data;
 
     // clean up
     _clusters.clear();
-    _results.clear();
+    _palette.clear();
+    _labels.clear();
+    if ( data.empty() ) return;
 
-    // init first cluster with indices
-    std::vector<SizeType> indices;
+    // init first cluster with all indices
+    _indices.resize(data.size());
     for ( SizeType i=0; i < data.size(); i++ )
     {
-      indices.push_back(i);
+      _indices[i] = i;
     }
-    _clusters.push_back(Cluster(_data, indices));
+    _nodes.assign(1, Cluster(0, data.size()));
+    _children.assign(1, 0);
+    update_bounds(_nodes[0]);
+    _clusters.push_back(_nodes[0]);
     std::make_heap(_clusters.begin(), _clusters.end());
 
-    // main loop
+    // main loop, each split partitions a range of _indices in place
     while ( _clusters.size() < _nClusters )
     {
-      Cluster c1(_data), c2(_data);
+      // the widest cluster is a single color, nothing left to split
+      const Cluster & top = _clusters.front();
+      if ( top.getLength(top.split_component) <= 0 ) break;
+
       std::pop_heap(_clusters.begin(), _clusters.end());
-      split(_clusters.back(), c1, c2);
+      const SizeType node = _clusters.back().node;
+      if ( !_children[node] )
+      {
+        split_ahead(node);
+      }
       _clusters.pop_back();
-      _clusters.push_back(c1);
+      _clusters.push_back(_nodes[_children[node]]);
       std::push_heap(_clusters.begin(), _clusters.end());
-      _clusters.push_back(c2);
+      _clusters.push_back(_nodes[_children[node]+1]);
       std::push_heap(_clusters.begin(), _clusters.end());
     }
 
@@ -163,32 +213,102 @@ public:
     generate_results();
   }
 
-  /** find median
+  /** split a node now, and other large clusters of the heap with it
    *
-   * for odd list, it picks the middle one
-   * for even list, it prefers the right middle one
+   * Clusters in the heap cover disjoint index ranges, so their splits are
+   * independent. Only the node itself is guaranteed to be needed, the
+   * others are the largest remaining candidates.
    */
-  template <typename TT>
-  static TT findMedian(std::vector<TT> t, SizeType l, SizeType r)
+  void split_ahead(SizeType node)
   {
-    if ( r-l < 2 ) return t[l];
-    TT pivot = t[l];
-    SizeType i, idx;
-    for ( i=idx=l+1; i < r; i++ )
+    static const SizeType min_task_size = 1 << 14;
+
+    std::vector<SizeType> batch(1, node);
+    if ( _max_tasks > 1 && _nodes[node].size() >= min_task_size )
     {
-      if ( t[i] < pivot )
+      // every entry but the popped one at the back
+      std::vector<Cluster> candidates;
+      for ( SizeType i=0; i+1 < _clusters.size(); i++ )
       {
-        std::swap(t[idx++], t[i]);
+        const Cluster & c = _clusters[i];
+        if ( !_children[c.node] && c.size() >= min_task_size &&
+             c.getLength(c.split_component) > 0 )
+        {
+          candidates.push_back(c);
+        }
+      }
+      const SizeType n = std::min(candidates.size(), _max_tasks-1);
+      std::partial_sort(candidates.begin(), candidates.begin()+n, candidates.end(),
+                        std::greater<Cluster>());
+      for ( SizeType i=0; i < n; i++ )
+      {
+        batch.push_back(candidates[i].node);
       }
     }
-    std::swap(t[idx-1], t[l]);
-    if ( idx <= t.size()/2 )
+
+    // create all child nodes up front, the tree must not grow while
+    // the batch is being split
+    for ( SizeType i=0; i < batch.size(); i++ )
     {
-      return findMedian(t, idx, r);
+      _children[batch[i]] = _nodes.size();
+      _nodes.resize(_nodes.size()+2);
+      _children.resize(_children.size()+2, 0);
     }
-    else
+    split_nodes(batch);
+  }
+
+  /// split every node of the batch, serially unless overridden
+  virtual void split_nodes(const std::vector<SizeType> & batch)
+  {
+    for ( SizeType i=0; i < batch.size(); i++ )
     {
-      return findMedian(t, l, idx);
+      split_node(batch[i]);
+    }
+  }
+
+  /// split one node into its two preallocated children
+  void split_node(SizeType node)
+  {
+    const SizeType child = _children[node];
+    split(_nodes[node], _nodes[child], _nodes[child+1]);
+    for ( SizeType c=child; c < child+2; c++ )
+    {
+      _nodes[c].node = c;
+      update_bounds(_nodes[c]);
+    }
+  }
+
+  /// number of samples element i stands for
+  SizeType weight(SizeType i) const
+  {
+    return _weights ? (*_weights)[i] : 1;
+  }
+
+  /** compute the bounding box and split key of a cluster
+   *
+   * Called once when a cluster is complete, so that heap comparisons
+   * and splits never have to rescan the indices.
+   */
+  void update_bounds(Cluster & c) const
+  {
+    if ( !c.size() ) return;
+    c.minimum = c.maximum = (*_data)[_indices[c.begin]];
+    for ( SizeType i=c.begin+1; i < c.end; i++ )
+    {
+      const T & t = (*_data)[_indices[i]];
+      for ( SizeType k=0; k < 3; k++ )
+      {
+        if ( t[k] < c.minimum[k] ) c.minimum[k] = t[k];
+        if ( c.maximum[k] < t[k] ) c.maximum[k] = t[k];
+      }
+    }
+    c.split_component = 0;
+    for ( SizeType k=1; k < 3; k++ )
+    {
+      if ( c.getLength(k) > c.getLength(c.split_component) )
+      {
+        c.split_component = k;
+      }
     }
   }
 
@@ -198,9 +318,15 @@ protected:
 
 protected:
   const SizeType _nClusters;
+  SizeType _max_tasks;
   const std::vector<T> * _data;
-  std::vector<Cluster> _clusters;
-  std::map<SizeType, T> _results;
+  const std::vector<SizeType> * _weights; ///< NULL when every element counts once
+  std::vector<SizeType> _indices; ///< permutation of the data, one range per cluster
+  std::vector<Cluster> _clusters; ///< heap of the current leaves
+  std::vector<Cluster> _nodes; ///< every cluster ever created, the split tree
+  std::vector<SizeType> _children; ///< first child of each node, 0 if not split
+  std::vector<T> _palette;
+  std::vector<LabelType> _labels;
 
 };
 
@@ -2,6 +2,7 @@
 #define __NEAREST_RESAMPLER_HPP__
 
 #include "Resampler.hpp"
+#include "SeparableResize.hpp"
 
 PRJ_BEGIN
 
@@ -16,6 +17,8 @@ public:
 
   virtual void resample(SizeType w, SizeType h);
 
+protected:
+  SeparableResize<NearestKernel> _resize;
 };
 
 PRJ_END
@@ -0,0 +1,190 @@
+#ifndef __PALETTE_KERNEL_HPP__
+#define __PALETTE_KERNEL_HPP__
+
+#include "Config.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+PRJ_BEGIN
+
+/** exp(x) in single precision without a libm call
+ *
+ * Cephes-style range reduction to 2^n * e^f with |f| <= ln(2)/2 and a
+ * degree 6 polynomial for e^f, accurate to about one ulp. The vector
+ * versions below evaluate exactly the same steps.
+ */
+inline float fast_exp(float x)
+{
+  x = std::min(std::max(x, -87.3f), 88.3f);
+  const float n = std::nearbyint(x * 1.44269504088896341f);
+  float f = x - n * 0.693359375f;
+  f = f - n * -2.12194440e-4f;
+  float y = 1.9875691500e-4f;
+  y = y * f + 1.3981999507e-3f;
+  y = y * f + 8.3334519073e-3f;
+  y = y * f + 4.1665795894e-2f;
+  y = y * f + 1.6666665459e-1f;
+  y = y * f + 5.0000001201e-1f;
+  y = y * (f * f) + f + 1.0f;
+  const int32_t bits = (int32_t(n) + 127) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return y * scale;
+}
+
+#if defined(__SSE2__)
+inline __m128 fast_exp(__m128 x)
+{
+  x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-87.3f)), _mm_set1_ps(88.3f));
+  const __m128i ni = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)));
+  const __m128 n = _mm_cvtepi32_ps(ni);
+  __m128 f = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(0.693359375f)));
+  f = _mm_sub_ps(f, _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+  __m128 y = _mm_set1_ps(1.9875691500e-4f);
+  y = _mm_add_ps(_mm_mul_ps(y, f), _mm_set1_ps(1.3981999507e-3f));
+  y = _mm_add_ps(_mm_mul_ps(y, f), _mm_set1_ps(8.3334519073e-3f));
+  y = _mm_add_ps(_mm_mul_ps(y, f), _mm_set1_ps(4.1665795894e-2f));
+  y = _mm_add_ps(_mm_mul_ps(y, f), _mm_set1_ps(1.6666665459e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, f), _mm_set1_ps(5.0000001201e-1f));
+  y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(f, f)), f), _mm_set1_ps(1.0f));
+  const __m128i bits = _mm_slli_epi32(_mm_add_epi32(ni, _mm_set1_epi32(127)), 23);
+  return _mm_mul_ps(y, _mm_castsi128_ps(bits));
+}
+#endif
+
+#if defined(__AVX2__)
+inline __m256 fast_exp(__m256 x)
+{
+  x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.3f)), _mm256_set1_ps(88.3f));
+  const __m256i ni = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)));
+  const __m256 n = _mm256_cvtepi32_ps(ni);
+  __m256 f = _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(0.693359375f)));
+  f = _mm256_sub_ps(f, _mm256_mul_ps(n, _mm256_set1_ps(-2.12194440e-4f)));
+  __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+  y = _mm256_add_ps(_mm256_mul_ps(y, f), _mm256_set1_ps(1.3981999507e-3f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, f), _mm256_set1_ps(8.3334519073e-3f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, f), _mm256_set1_ps(4.1665795894e-2f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, f), _mm256_set1_ps(1.6666665459e-1f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, f), _mm256_set1_ps(5.0000001201e-1f));
+  y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(y, _mm256_mul_ps(f, f)), f), _mm256_set1_ps(1.0f));
+  const __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(ni, _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(y, _mm256_castsi256_ps(bits));
+}
+#endif
+
+/** Euclidean distances from one color to n palette entries
+ *
+ * The palette is planar (L, a, b arrays) so that consecutive entries
+ * fill a vector register.
+ */
+inline void palette_distances(const float * L, const float * a, const float * b,
+                              SizeType n, const float color[3], float * out)
+{
+  SizeType i = 0;
+#if defined(__AVX2__)
+  {
+    const __m256 cL = _mm256_set1_ps(color[0]);
+    const __m256 ca = _mm256_set1_ps(color[1]);
+    const __m256 cb = _mm256_set1_ps(color[2]);
+    for ( ; i+8 <= n; i+=8 )
+    {
+      const __m256 dL = _mm256_sub_ps(_mm256_loadu_ps(L+i), cL);
+      const __m256 da = _mm256_sub_ps(_mm256_loadu_ps(a+i), ca);
+      const __m256 db = _mm256_sub_ps(_mm256_loadu_ps(b+i), cb);
+      const __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dL, dL),
+                                                    _mm256_mul_ps(da, da)),
+                                      _mm256_mul_ps(db, db));
+      _mm256_storeu_ps(out+i, _mm256_sqrt_ps(d2));
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  {
+    const __m128 cL = _mm_set1_ps(color[0]);
+    const __m128 ca = _mm_set1_ps(color[1]);
+    const __m128 cb = _mm_set1_ps(color[2]);
+    for ( ; i+4 <= n; i+=4 )
+    {
+      const __m128 dL = _mm_sub_ps(_mm_loadu_ps(L+i), cL);
+      const __m128 da = _mm_sub_ps(_mm_loadu_ps(a+i), ca);
+      const __m128 db = _mm_sub_ps(_mm_loadu_ps(b+i), cb);
+      const __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dL, dL),
+                                              _mm_mul_ps(da, da)),
+                                   _mm_mul_ps(db, db));
+      _mm_storeu_ps(out+i, _mm_sqrt_ps(d2));
+    }
+  }
+#endif
+  for ( ; i < n; i++ )
+  {
+    const float dL = L[i] - color[0];
+    const float da = a[i] - color[1];
+    const float db = b[i] - color[2];
+    out[i] = std::sqrt(dL*dL + da*da + db*db);
+  }
+}
+
+/** Gibbs weights prior[i] * exp((error[i]-offset) * scale) of n entries
+ *
+ * Writes the weights to out and returns their sum. Shifting the errors by
+ * the smallest one keeps the largest weight away from underflow without
+ * changing the normalized distribution.
+ */
+inline float gibbs_weights(const float * error, const float * prior, SizeType n,
+                           float offset, float scale, float * out)
+{
+  SizeType i = 0;
+  float sum = 0;
+#if defined(__AVX2__)
+  {
+    const __m256 voff = _mm256_set1_ps(offset);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    __m256 vsum = _mm256_setzero_ps();
+    for ( ; i+8 <= n; i+=8 )
+    {
+      const __m256 x = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(error+i), voff), vscale);
+      const __m256 p = _mm256_mul_ps(_mm256_loadu_ps(prior+i), fast_exp(x));
+      _mm256_storeu_ps(out+i, p);
+      vsum = _mm256_add_ps(vsum, p);
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, vsum);
+    for ( int k=0; k < 8; k++ ) sum += lanes[k];
+  }
+#endif
+#if defined(__SSE2__)
+  {
+    const __m128 voff = _mm_set1_ps(offset);
+    const __m128 vscale = _mm_set1_ps(scale);
+    __m128 vsum = _mm_setzero_ps();
+    for ( ; i+4 <= n; i+=4 )
+    {
+      const __m128 x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(error+i), voff), vscale);
+      const __m128 p = _mm_mul_ps(_mm_loadu_ps(prior+i), fast_exp(x));
+      _mm_storeu_ps(out+i, p);
+      vsum = _mm_add_ps(vsum, p);
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, vsum);
+    for ( int k=0; k < 4; k++ ) sum += lanes[k];
+  }
+#endif
+  for ( ; i < n; i++ )
+  {
+    out[i] = prior[i] * fast_exp((error[i]-offset) * scale);
+    sum += out[i];
+  }
+  return sum;
+}
+
+PRJ_END
+
+#endif //__PALETTE_KERNEL_HPP__
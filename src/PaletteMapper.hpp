@@ -0,0 +1,231 @@
+#ifndef __PALETTE_MAPPER_HPP__
+#define __PALETTE_MAPPER_HPP__
+
+#include "Config.hpp"
+#include "Parallel.hpp"
+#include "ColorConversion.hpp"
+
+#include <vector>
+#include <limits>
+#include <cstring>
+#include <opencv2/opencv.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+PRJ_BEGIN
+
+/** maps BGR pixels to the nearest color of a fixed palette
+ *
+ * build() decides the nearest palette entry once for every cell of a
+ * 3D grid over BGR with the given bits per channel (the cell center
+ * stands for the whole cell), after that map() is a table lookup per
+ * pixel. With 8 bits the table is exact and takes 64 MB, 6 bits are
+ * within 2 levels per channel and take 1 MB.
+ */
+class PaletteMapper {
+public:
+  /// distance used to pick the nearest palette color
+  enum Metric {
+    METRIC_BGR, ///< squared BGR difference
+    METRIC_LAB  ///< squared CIE Lab difference
+  };
+
+public:
+  PaletteMapper()
+    : _bits(0), _shift(0)
+  {
+  }
+
+  bool empty() const
+  {
+    return _palette.empty();
+  }
+
+  const std::vector<cv::Vec3b> & getPalette() const
+  {
+    return _palette;
+  }
+
+  void build(const std::vector<cv::Vec3b> & palette, SizeType bits=6, Metric metric=METRIC_BGR)
+  {
+    ASSERT(!palette.empty() && palette.size() <= 65536);
+    ASSERT(1 <= bits && bits <= 8);
+    _palette = palette;
+    _bits = int(bits);
+    _shift = 8-_bits;
+
+    // cell centers and palette in the metric space, as float rows
+    const SizeType n_cells = SizeType(1) << (3*_bits);
+    const int side = 1 << _bits;
+    const int half = _shift ? 1 << (_shift-1) : 0;
+    cv::Mat centers(side*side, side, CV_8UC3);
+    for ( SizeType k=0; k < n_cells; k++ )
+    {
+      centers.at<cv::Vec3b>(int(k >> _bits), int(k & (side-1))) = cv::Vec3b(
+          ((k >> (2*_bits)) << _shift) + half,
+          (((k >> _bits) & (side-1)) << _shift) + half,
+          ((k & (side-1)) << _shift) + half);
+    }
+    cv::Mat colors(1, int(palette.size()), CV_8UC3, const_cast<cv::Vec3b *>(&palette[0]));
+    cv::Mat centers_f, colors_f;
+    to_metric(centers, centers_f, metric);
+    to_metric(colors, colors_f, metric);
+
+    // brute force once per cell, rows of cells in parallel
+    _labels.resize(n_cells);
+    _colors.resize(n_cells);
+    const SizeType n = palette.size();
+    const cv::Vec3f * pal = colors_f.ptr<cv::Vec3f>(0);
+    parallel_for(0, SizeType(side*side), [&](SizeType row)
+    {
+      const cv::Vec3f * cell = centers_f.ptr<cv::Vec3f>(int(row));
+      for ( int i=0; i < side; i++ )
+      {
+        SizeType best = 0;
+        float best_d = std::numeric_limits<float>::max();
+        for ( SizeType p=0; p < n; p++ )
+        {
+          const float d0 = cell[i][0]-pal[p][0];
+          const float d1 = cell[i][1]-pal[p][1];
+          const float d2 = cell[i][2]-pal[p][2];
+          const float d = d0*d0 + d1*d1 + d2*d2;
+          if ( d < best_d )
+          {
+            best_d = d;
+            best = p;
+          }
+        }
+        const SizeType k = row*side+i;
+        _labels[k] = uint16_t(best);
+        const cv::Vec3b & c = palette[best];
+        _colors[k] = uint32_t(c[0]) | (uint32_t(c[1]) << 8) | (uint32_t(c[2]) << 16);
+      }
+    });
+  }
+
+  /// palette index of one pixel
+  uint16_t label(const cv::Vec3b & c) const
+  {
+    return _labels[cell(c[0], c[1], c[2])];
+  }
+
+  /// replace every pixel by its palette color, in may be out
+  void map(const cv::Mat & in, cv::Mat & out) const
+  {
+    ASSERT(!empty() && in.type() == CV_8UC3);
+    out.create(in.size(), CV_8UC3);
+    parallel_for(0, SizeType(in.rows), [&](SizeType j)
+    {
+      map_row(in.ptr<unsigned char>(int(j)), out.ptr<unsigned char>(int(j)), in.cols);
+    });
+  }
+
+  /// n BGR pixels of one row, in may be out
+  void map(const unsigned char * in, unsigned char * out, SizeType n) const
+  {
+    ASSERT(!empty());
+    map_row(in, out, int(n));
+  }
+
+  /// palette index of every pixel, for indexed output
+  void mapLabels(const cv::Mat & in, cv::Mat & labels) const
+  {
+    ASSERT(!empty() && in.type() == CV_8UC3);
+    labels.create(in.size(), CV_16UC1);
+    parallel_for(0, SizeType(in.rows), [&](SizeType j)
+    {
+      const cv::Vec3b * row = in.ptr<cv::Vec3b>(int(j));
+      uint16_t * out = labels.ptr<uint16_t>(int(j));
+      for ( int i=0; i < in.cols; i++ )
+      {
+        out[i] = label(row[i]);
+      }
+    });
+  }
+
+protected:
+  SizeType cell(unsigned b, unsigned g, unsigned r) const
+  {
+    return (SizeType(b >> _shift) << (2*_bits)) |
+           (SizeType(g >> _shift) << _bits) | SizeType(r >> _shift);
+  }
+
+  static void to_metric(const cv::Mat & bgr, cv::Mat & out, Metric metric)
+  {
+    if ( metric == METRIC_LAB )
+    {
+      bgr_to_lab(bgr, out);
+    }
+    else
+    {
+      bgr.convertTo(out, CV_32FC3);
+    }
+  }
+
+  void map_row(const unsigned char * in, unsigned char * out, int n) const
+  {
+    int i = 0;
+#if defined(__AVX2__)
+    // 8 pixels per step: spread B, G, R into 32-bit lanes, form the cell
+    // index, gather the packed colors and pack them back to 24 bits.
+    // Each step reads 28 bytes past the first pixel and writes only its
+    // own 24, so the row can be mapped in place.
+    const __m256i take_b = _mm256_setr_epi8(0,-1,-1,-1, 3,-1,-1,-1, 6,-1,-1,-1, 9,-1,-1,-1,
+                                            0,-1,-1,-1, 3,-1,-1,-1, 6,-1,-1,-1, 9,-1,-1,-1);
+    const __m256i take_g = _mm256_setr_epi8(1,-1,-1,-1, 4,-1,-1,-1, 7,-1,-1,-1, 10,-1,-1,-1,
+                                            1,-1,-1,-1, 4,-1,-1,-1, 7,-1,-1,-1, 10,-1,-1,-1);
+    const __m256i take_r = _mm256_setr_epi8(2,-1,-1,-1, 5,-1,-1,-1, 8,-1,-1,-1, 11,-1,-1,-1,
+                                            2,-1,-1,-1, 5,-1,-1,-1, 8,-1,-1,-1, 11,-1,-1,-1);
+    const __m256i pack = _mm256_setr_epi8(0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1,
+                                          0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1);
+    const __m128i shift = _mm_cvtsi32_si128(_shift);
+    const __m128i shift_g = _mm_cvtsi32_si128(_bits);
+    const __m128i shift_b = _mm_cvtsi32_si128(2*_bits);
+    const int * table = reinterpret_cast<const int *>(&_colors[0]);
+    for ( ; 3*i+28 <= 3*n; i+=8 )
+    {
+      const unsigned char * p = in + 3*i;
+      const __m256i px = _mm256_inserti128_si256(
+          _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))),
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(p+12)), 1);
+      const __m256i b = _mm256_srl_epi32(_mm256_shuffle_epi8(px, take_b), shift);
+      const __m256i g = _mm256_srl_epi32(_mm256_shuffle_epi8(px, take_g), shift);
+      const __m256i r = _mm256_srl_epi32(_mm256_shuffle_epi8(px, take_r), shift);
+      const __m256i index = _mm256_or_si256(
+          _mm256_or_si256(_mm256_sll_epi32(b, shift_b), _mm256_sll_epi32(g, shift_g)), r);
+      const __m256i packed = _mm256_shuffle_epi8(_mm256_i32gather_epi32(table, index, 4), pack);
+      const __m128i lo = _mm256_castsi256_si128(packed);
+      const __m128i hi = _mm256_extracti128_si256(packed, 1);
+      unsigned char * q = out + 3*i;
+      const int32_t lo_tail = _mm_cvtsi128_si32(_mm_srli_si128(lo, 8));
+      const int32_t hi_tail = _mm_cvtsi128_si32(_mm_srli_si128(hi, 8));
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(q), lo);
+      std::memcpy(q+8, &lo_tail, 4);
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(q+12), hi);
+      std::memcpy(q+20, &hi_tail, 4);
+    }
+#endif
+    for ( ; i < n; i++ )
+    {
+      const unsigned char * p = in + 3*i;
+      const uint32_t c = _colors[cell(p[0], p[1], p[2])];
+      unsigned char * q = out + 3*i;
+      q[0] = c & 0xff;
+      q[1] = (c >> 8) & 0xff;
+      q[2] = (c >> 16) & 0xff;
+    }
+  }
+
+protected:
+  std::vector<cv::Vec3b> _palette;
+  int _bits;
+  int _shift;
+  std::vector<uint16_t> _labels; ///< palette index of every cell
+  std::vector<uint32_t> _colors; ///< palette color of every cell, packed BGR
+};
+
+PRJ_END
+
+#endif //__PALETTE_MAPPER_HPP__
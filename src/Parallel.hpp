@@ -0,0 +1,47 @@
+#ifndef __PARALLEL_HPP__
+#define __PARALLEL_HPP__
+
+#include "Config.hpp"
+
+#include <opencv2/opencv.hpp>
+
+PRJ_BEGIN
+
+/// Adapts any callable taking an index to cv::ParallelLoopBody.
+template <typename Body>
+class ParallelLoop : public cv::ParallelLoopBody {
+public:
+  ParallelLoop(const Body & body)
+    : _body(body)
+  {
+  }
+
+  virtual void operator()(const cv::Range & range) const
+  {
+    for ( int i=range.start; i < range.end; i++ )
+    {
+      _body(SizeType(i));
+    }
+  }
+
+protected:
+  const Body & _body;
+
+};
+
+/** run body(i) for every i in [begin, end) on OpenCV's thread pool
+ *
+ * Each index is a unit of work (e.g. a tile of rows), so callers
+ * should pass coarse indices rather than single pixels.
+ */
+template <typename Body>
+inline void parallel_for(SizeType begin, SizeType end, const Body & body)
+{
+  if ( begin >= end ) return;
+  cv::parallel_for_(cv::Range(int(begin), int(end)),
+                    ParallelLoop<Body>(body), double(end-begin));
+}
+
+PRJ_END
+
+#endif //__PARALLEL_HPP__
@@ -0,0 +1,506 @@
+#include "Quantizer.hpp"
+#include "cvMedianCut.hpp"
+#include "Parallel.hpp"
+#include "PaletteKernel.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+USE_PRJ_NAMESPACE;
+
+/// row ranges of the histogram passes, summed in a fixed order
+static const SizeType max_parts = 8;
+
+/// pixel count of every color bin, over parallel row ranges
+static void count_bins(const cv::Mat & image, int bits, std::vector<uint32_t> & hist)
+{
+  ASSERT(image.type() == CV_8UC3);
+  const SizeType n_bins = SizeType(1) << (3*bits);
+  const SizeType n_parts = std::min(histogram_parts(image.total(), n_bins, max_parts),
+                                    SizeType(image.rows));
+  std::vector<uint32_t> partials(n_parts*n_bins, 0);
+  parallel_for(0, n_parts, [&](SizeType p)
+  {
+    uint32_t * part = &partials[p*n_bins];
+    const int j1 = int((p+1)*image.rows/n_parts);
+    for ( int j=int(p*image.rows/n_parts); j < j1; j++ )
+    {
+      const cv::Vec3b * row = image.ptr<cv::Vec3b>(j);
+      for ( int i=0; i < image.cols; i++ )
+      {
+        part[color_bin(row[i], bits)]++;
+      }
+    }
+  });
+
+  hist.assign(n_bins, 0);
+  for ( SizeType p=0; p < n_parts; p++ )
+  {
+    for ( SizeType k=0; k < n_bins; k++ )
+    {
+      hist[k] += partials[p*n_bins+k];
+    }
+  }
+}
+
+/** occupied bins of a color histogram, in increasing bin order
+ *
+ * Each bin is represented by its center color.
+ */
+static void occupied_bins(const std::vector<uint32_t> & hist, int bits, std::vector<cv::Vec3b> & colors,
+                          std::vector<SizeType> & counts, std::vector<SizeType> & bins)
+{
+  ASSERT(hist.size() == SizeType(1) << (3*bits));
+  colors.clear();
+  counts.clear();
+  bins.clear();
+  const int shift = 8-bits;
+  const unsigned char half = shift ? 1 << (shift-1) : 0;
+  const SizeType mask = (SizeType(1) << bits) - 1;
+  for ( SizeType k=0; k < hist.size(); k++ )
+  {
+    if ( !hist[k] ) continue;
+    colors.push_back(cv::Vec3b(((k >> (2*bits)) << shift) + half,
+                               (((k >> bits) & mask) << shift) + half,
+                               ((k & mask) << shift) + half));
+    counts.push_back(hist[k]);
+    bins.push_back(k);
+  }
+}
+
+/// palette color of every bin, unoccupied bins get the first one
+static void fill_lut(SizeType n_bins, const std::vector<SizeType> & bins, const std::vector<uint16_t> & labels,
+                     const std::vector<cv::Vec3b> & palette, std::vector<cv::Vec3b> & lut)
+{
+  lut.assign(n_bins, palette[0]);
+  for ( SizeType i=0; i < bins.size(); i++ )
+  {
+    lut[bins[i]] = palette[labels[i]];
+  }
+}
+
+/// replace every pixel by the color of its bin
+static void map_bins(cv::Mat & image, int bits, const std::vector<cv::Vec3b> & lut)
+{
+  const SizeType n_parts = std::min(max_parts, SizeType(image.rows));
+  parallel_for(0, n_parts, [&](SizeType p)
+  {
+    const int j1 = int((p+1)*image.rows/n_parts);
+    for ( int j=int(p*image.rows/n_parts); j < j1; j++ )
+    {
+      cv::Vec3b * row = image.ptr<cv::Vec3b>(j);
+      for ( int i=0; i < image.cols; i++ )
+      {
+        row[i] = lut[color_bin(row[i], bits)];
+      }
+    }
+  });
+}
+
+void MedianCutQuantizer::reduce(SizeType nColors, cv::Mat & image) const
+{
+  if ( !nColors ) return;
+  cvMedianCut cut(nColors);
+  cut.setParallelSplits(cv::getNumThreads());
+  // clusters are split by value only, so the pixel order does not matter
+  std::vector<cv::Vec3b> data(image.total());
+  for ( int j=0; j < image.rows; j++ )
+  {
+    const cv::Vec3b * row = image.ptr<cv::Vec3b>(j);
+    std::copy(row, row+image.cols, &data[SizeType(j)*image.cols]);
+  }
+  cut.process(data);
+  const std::vector<cv::Vec3b> & palette = cut.getPalette();
+  const uint16_t * label = cut.getLabels().data();
+  for ( int j=0; j < image.rows; j++ )
+  {
+    cv::Vec3b * row = image.ptr<cv::Vec3b>(j);
+    for ( int i=0; i < image.cols; i++ )
+    {
+      row[i] = palette[*label++];
+    }
+  }
+}
+
+BinnedQuantizer::BinnedQuantizer(SizeType bits)
+  : _bits(int(bits))
+{
+  ASSERT(1 <= bits && bits <= max_histogram_bits);
+}
+
+void BinnedQuantizer::reduce(SizeType nColors, cv::Mat & image) const
+{
+  if ( !nColors ) return;
+  std::vector<uint32_t> hist;
+  count_bins(image, _bits, hist);
+  std::vector<cv::Vec3b> lut;
+  reduceHistogram(nColors, hist, lut);
+  if ( lut.empty() ) return;
+  map_bins(image, _bits, lut);
+}
+
+void HistogramQuantizer::reduceHistogram(SizeType nColors, const std::vector<uint32_t> & hist,
+                                         std::vector<cv::Vec3b> & lut) const
+{
+  lut.clear();
+  std::vector<cv::Vec3b> colors;
+  std::vector<SizeType> counts, bins;
+  occupied_bins(hist, _bits, colors, counts, bins);
+  if ( colors.empty() ) return;
+
+  cvMedianCut cut(nColors);
+  cut.process(colors, counts);
+  fill_lut(hist.size(), bins, cut.getLabels(), cut.getPalette(), lut);
+}
+
+void KMeansQuantizer::reduceHistogram(SizeType nColors, const std::vector<uint32_t> & hist,
+                                      std::vector<cv::Vec3b> & lut) const
+{
+  // bins per work item, fixed so the reduction order is too
+  static const SizeType chunk_size = 1024;
+
+  lut.clear();
+  std::vector<cv::Vec3b> colors;
+  std::vector<SizeType> counts, bins;
+  occupied_bins(hist, _bits, colors, counts, bins);
+  if ( colors.empty() ) return;
+
+  // median cut gives the initial centers and assignment
+  cvMedianCut cut(nColors);
+  cut.process(colors, counts);
+  std::vector<uint16_t> labels = cut.getLabels();
+  const SizeType k = cut.getPalette().size();
+  std::vector<float> centers(3*k); ///< planar B, G, R
+  for ( SizeType c=0; c < k; c++ )
+  {
+    for ( int ch=0; ch < 3; ch++ )
+    {
+      centers[ch*k+c] = cut.getPalette()[c][ch];
+    }
+  }
+
+  const SizeType n = colors.size();
+  const SizeType n_chunks = (n+chunk_size-1) / chunk_size;
+  std::vector<double> partials(4*k*n_chunks);
+  std::vector<float> distances(k*n_chunks);
+  for ( SizeType pass=0; pass < _passes; pass++ )
+  {
+    // assign every bin to its nearest center and sum the bins per center
+    std::fill(partials.begin(), partials.end(), 0.0);
+    parallel_for(0, n_chunks, [&](SizeType chunk)
+    {
+      float * d = &distances[k*chunk];
+      double * sums = &partials[4*k*chunk];
+      const SizeType i1 = std::min((chunk+1)*chunk_size, n);
+      for ( SizeType i=chunk*chunk_size; i < i1; i++ )
+      {
+        const float color[3] = {float(colors[i][0]), float(colors[i][1]), float(colors[i][2])};
+        palette_distances(&centers[0], &centers[k], &centers[2*k], k, color, d);
+        const SizeType best = std::min_element(d, d+k) - d;
+        labels[i] = uint16_t(best);
+        const double w = double(counts[i]);
+        sums[4*best+0] += w*color[0];
+        sums[4*best+1] += w*color[1];
+        sums[4*best+2] += w*color[2];
+        sums[4*best+3] += w;
+      }
+    });
+
+    // move the centers, an empty one stays where it is
+    for ( SizeType c=0; c < k; c++ )
+    {
+      double s[4] = {0, 0, 0, 0};
+      for ( SizeType chunk=0; chunk < n_chunks; chunk++ )
+      {
+        for ( int m=0; m < 4; m++ )
+        {
+          s[m] += partials[4*(k*chunk+c)+m];
+        }
+      }
+      if ( s[3] > 0 )
+      {
+        for ( int ch=0; ch < 3; ch++ )
+        {
+          centers[ch*k+c] = float(s[ch]/s[3]);
+        }
+      }
+    }
+  }
+
+  std::vector<cv::Vec3b> palette(k);
+  for ( SizeType c=0; c < k; c++ )
+  {
+    palette[c] = cv::Vec3b(cv::saturate_cast<uchar>(centers[c]),
+                           cv::saturate_cast<uchar>(centers[k+c]),
+                           cv::saturate_cast<uchar>(centers[2*k+c]));
+  }
+  fill_lut(hist.size(), bins, labels, palette, lut);
+}
+
+namespace {
+
+/// color octree with a bounded number of leaves
+class Octree {
+public:
+  static const int depth = 8;
+
+  Octree()
+    : _leaves(0), _stamp(0)
+  {
+    _nodes.reserve(1024);
+    allocate(0);
+  }
+
+  SizeType leaves() const
+  {
+    return _leaves;
+  }
+
+  void insert(const cv::Vec3b & c)
+  {
+    int32_t node = 0;
+    for ( int level=0; ; level++ )
+    {
+      _nodes[node].count++;
+      if ( _nodes[node].leaf ) break;
+      const int ci = child_index(c, level);
+      if ( _nodes[node].child[ci] < 0 )
+      {
+        const int32_t child = allocate(level+1);
+        _nodes[node].child[ci] = child;
+      }
+      node = _nodes[node].child[ci];
+    }
+    Node & leaf = _nodes[node];
+    leaf.sum[0] += c[0];
+    leaf.sum[1] += c[1];
+    leaf.sum[2] += c[2];
+  }
+
+  /** merge the children of the deepest inner node with the fewest pixels
+   *
+   * Each level keeps a heap of its inner nodes by pixel count. Counts only
+   * grow, so an entry whose count is stale is pushed again with the
+   * current one, and entries of nodes merged or reused are dropped.
+   */
+  void reduce()
+  {
+    for ( int level=depth-1; level >= 0; level-- )
+    {
+      std::vector<Reducible> & heap = _reducible[level];
+      while ( !heap.empty() )
+      {
+        std::pop_heap(heap.begin(), heap.end());
+        const Reducible r = heap.back();
+        heap.pop_back();
+        const Node & n = _nodes[r.node];
+        if ( n.leaf || n.stamp != r.stamp ) continue;
+        if ( n.count != r.count )
+        {
+          push_reducible(level, r.node);
+          continue;
+        }
+        merge(r.node);
+        return;
+      }
+    }
+    ASSERT_MSG(false, "nothing left to reduce");
+  }
+
+  /// number the leaves and return their mean colors
+  void palette(std::vector<cv::Vec3b> & colors)
+  {
+    colors.clear();
+    index_leaves(0, colors);
+  }
+
+  /** palette index of a color
+   *
+   * Merges never cut the path of an inserted color, they only turn a node
+   * on it into a leaf, so every color of the image finds its own branch.
+   * Any other color takes the first existing child where its branch is
+   * missing, which is not necessarily the closest one.
+   */
+  uint16_t lookup(const cv::Vec3b & c) const
+  {
+    int32_t node = 0;
+    for ( int level=0; !_nodes[node].leaf; level++ )
+    {
+      int32_t child = _nodes[node].child[child_index(c, level)];
+      for ( int ci=0; child < 0 && ci < 8; ci++ )
+      {
+        child = _nodes[node].child[ci];
+      }
+      node = child;
+    }
+    return _nodes[node].index;
+  }
+
+protected:
+  struct Node {
+    SizeType count;  ///< pixels inserted below the node
+    SizeType sum[3]; ///< of the pixels of a leaf
+    int32_t child[8];
+    uint32_t stamp;  ///< allocation number, tells reused nodes apart
+    uint16_t index;
+    bool leaf;
+  };
+
+  /// heap entry of an inner node, the one with the fewest pixels on top
+  struct Reducible {
+    SizeType count;
+    int32_t node;
+    uint32_t stamp;
+    bool operator<(const Reducible & r) const
+    {
+      return count != r.count ? count > r.count : node > r.node;
+    }
+  };
+
+  static int child_index(const cv::Vec3b & c, int level)
+  {
+    const int bit = 7-level;
+    return (((c[0] >> bit) & 1) << 2) | (((c[1] >> bit) & 1) << 1) | ((c[2] >> bit) & 1);
+  }
+
+  int32_t allocate(int level)
+  {
+    int32_t node;
+    if ( _free.empty() )
+    {
+      node = int32_t(_nodes.size());
+      _nodes.push_back(Node());
+    }
+    else
+    {
+      node = _free.back();
+      _free.pop_back();
+    }
+    Node & n = _nodes[node];
+    n.count = 0;
+    n.sum[0] = n.sum[1] = n.sum[2] = 0;
+    std::fill(n.child, n.child+8, -1);
+    n.stamp = _stamp++;
+    n.index = 0;
+    n.leaf = (level == depth);
+    if ( n.leaf )
+    {
+      _leaves++;
+    }
+    else
+    {
+      push_reducible(level, node);
+    }
+    return node;
+  }
+
+  void push_reducible(int level, int32_t node)
+  {
+    const Reducible r = {_nodes[node].count, node, _nodes[node].stamp};
+    _reducible[level].push_back(r);
+    std::push_heap(_reducible[level].begin(), _reducible[level].end());
+  }
+
+  /// the children are leaves, their pixels are already counted in node
+  void merge(int32_t node)
+  {
+    Node & n = _nodes[node];
+    for ( int ci=0; ci < 8; ci++ )
+    {
+      const int32_t child = n.child[ci];
+      if ( child < 0 ) continue;
+      for ( int ch=0; ch < 3; ch++ )
+      {
+        n.sum[ch] += _nodes[child].sum[ch];
+      }
+      _free.push_back(child);
+      _leaves--;
+      n.child[ci] = -1;
+    }
+    n.leaf = true;
+    _leaves++;
+  }
+
+  void index_leaves(int32_t node, std::vector<cv::Vec3b> & colors)
+  {
+    Node & n = _nodes[node];
+    if ( n.leaf )
+    {
+      n.index = uint16_t(colors.size());
+      const SizeType count = std::max(n.count, SizeType(1));
+      colors.push_back(cv::Vec3b(n.sum[0]/count, n.sum[1]/count, n.sum[2]/count));
+      return;
+    }
+    for ( int ci=0; ci < 8; ci++ )
+    {
+      if ( n.child[ci] >= 0 ) index_leaves(n.child[ci], colors);
+    }
+  }
+
+protected:
+  std::vector<Node> _nodes;
+  std::vector<int32_t> _free;
+  std::vector<Reducible> _reducible[depth]; ///< inner nodes of every level
+  SizeType _leaves;
+  uint32_t _stamp;
+};
+
+}
+
+void OctreeQuantizer::reduce(SizeType nColors, cv::Mat & image) const
+{
+  if ( !nColors ) return;
+  ASSERT(image.type() == CV_8UC3 && nColors <= 65536);
+
+  // one streaming pass, merging as soon as there are too many leaves
+  Octree tree;
+  for ( int j=0; j < image.rows; j++ )
+  {
+    const cv::Vec3b * row = image.ptr<cv::Vec3b>(j);
+    for ( int i=0; i < image.cols; i++ )
+    {
+      tree.insert(row[i]);
+      while ( tree.leaves() > nColors )
+      {
+        tree.reduce();
+      }
+    }
+  }
+
+  std::vector<cv::Vec3b> palette;
+  tree.palette(palette);
+  parallel_for(0, SizeType(image.rows), [&](SizeType j)
+  {
+    cv::Vec3b * row = image.ptr<cv::Vec3b>(int(j));
+    for ( int i=0; i < image.cols; i++ )
+    {
+      row[i] = palette[tree.lookup(row[i])];
+    }
+  });
+}
+
+void UniformQuantizer::reduce(SizeType nColors, cv::Mat & image) const
+{
+  if ( !nColors ) return;
+  ASSERT(image.channels() == 3);
+
+  // the same number of levels on each channel, so at most nColors colors
+  int levels = 1;
+  while ( SizeType((levels+1)*(levels+1)*(levels+1)) <= nColors ) levels++;
+  const int step = (256+levels-1) / levels;
+  unsigned char table[256];
+  for ( int v=0; v < 256; v++ )
+  {
+    table[v] = cv::saturate_cast<uchar>(v/step*step + step/2);
+  }
+
+  parallel_for(0, SizeType(image.rows), [&](SizeType j)
+  {
+    unsigned char * row = image.ptr<unsigned char>(int(j));
+    for ( int i=0; i < 3*image.cols; i++ )
+    {
+      row[i] = table[row[i]];
+    }
+  });
+}
@@ -0,0 +1,127 @@
+#ifndef __QUANTIZER_HPP__
+#define __QUANTIZER_HPP__
+
+#include "Config.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <opencv2/opencv.hpp>
+
+PRJ_BEGIN
+
+/** color quantization strategy used by Resampler::reduce_color()
+ *
+ * Implementations keep no per-image state, so one instance can be
+ * shared by several resamplers and threads.
+ */
+class Quantizer {
+public:
+  virtual ~Quantizer() {}
+
+  /// replace the colors of image (CV_8UC3) by at most nColors colors
+  virtual void reduce(SizeType nColors, cv::Mat & image) const = 0;
+
+  virtual const char * name() const = 0;
+
+};
+
+/// most bits per channel of a histogram, 1 << 21 bins of 4 bytes
+static const int max_histogram_bits = 7;
+
+/** number of separate histograms to count pixels into, at most max_parts
+ *
+ * Every partial is cleared and summed bin by bin, so one only pays off
+ * when it gets at least as many pixels as there are bins.
+ */
+inline SizeType histogram_parts(SizeType pixels, SizeType n_bins, SizeType max_parts)
+{
+  return std::max(SizeType(1), std::min(max_parts, pixels/n_bins));
+}
+
+/// histogram bin of a color with bits per channel
+inline SizeType color_bin(const cv::Vec3b & c, int bits)
+{
+  const int shift = 8-bits;
+  return (SizeType(c[0]>>shift) << (2*bits)) |
+         (SizeType(c[1]>>shift) << bits) | SizeType(c[2]>>shift);
+}
+
+/// median cut over every pixel, the reference quality
+class MedianCutQuantizer : public Quantizer {
+public:
+  virtual void reduce(SizeType nColors, cv::Mat & image) const;
+  virtual const char * name() const { return "median cut"; }
+};
+
+/** quantizer that builds its palette from a reduced-precision histogram
+ *
+ * reduce() counts the pixels with color_bin(), calls reduceHistogram()
+ * and looks every pixel up, so a caller that produces the pixels can
+ * count them on the way instead.
+ */
+class BinnedQuantizer : public Quantizer {
+public:
+  virtual void reduce(SizeType nColors, cv::Mat & image) const;
+
+  /// bits per channel of the histogram
+  int histogramBits() const { return _bits; }
+
+  /// output color of every bin, hist holds 1 << 3*histogramBits() counts
+  virtual void reduceHistogram(SizeType nColors, const std::vector<uint32_t> & hist,
+                               std::vector<cv::Vec3b> & lut) const = 0;
+
+protected:
+  BinnedQuantizer(SizeType bits);
+
+protected:
+  int _bits;
+};
+
+/// median cut over the occupied bins of a reduced-precision histogram
+class HistogramQuantizer : public BinnedQuantizer {
+public:
+  HistogramQuantizer(SizeType bits=5) : BinnedQuantizer(bits) {}
+  virtual void reduceHistogram(SizeType nColors, const std::vector<uint32_t> & hist,
+                               std::vector<cv::Vec3b> & lut) const;
+  virtual const char * name() const { return "histogram median cut"; }
+};
+
+/** histogram median cut refined by weighted k-means over the bins
+ *
+ * A few Lloyd passes move the median cut colors to the centroids of
+ * the bins nearest to them, which lowers the error at a small cost
+ * since only occupied bins are visited.
+ */
+class KMeansQuantizer : public BinnedQuantizer {
+public:
+  KMeansQuantizer(SizeType bits=6, SizeType passes=4) : BinnedQuantizer(bits), _passes(passes) {}
+  virtual void reduceHistogram(SizeType nColors, const std::vector<uint32_t> & hist,
+                               std::vector<cv::Vec3b> & lut) const;
+  virtual const char * name() const { return "k-means"; }
+
+protected:
+  SizeType _passes;
+};
+
+/** single-pass octree quantizer
+ *
+ * Pixels are inserted into an 8-level color octree whose deepest nodes
+ * are merged whenever there are more than nColors leaves, so memory
+ * stays bounded by the palette size however large the image is.
+ */
+class OctreeQuantizer : public Quantizer {
+public:
+  virtual void reduce(SizeType nColors, cv::Mat & image) const;
+  virtual const char * name() const { return "octree"; }
+};
+
+/// fixed uniform levels per channel, the fastest and the coarsest
+class UniformQuantizer : public Quantizer {
+public:
+  virtual void reduce(SizeType nColors, cv::Mat & image) const;
+  virtual const char * name() const { return "uniform"; }
+};
+
+PRJ_END
+
+#endif //__QUANTIZER_HPP__
@@ -2,17 +2,30 @@
 #define __RESAMPLER_HPP__
 
 #include "Config.hpp"
-#include "cvMedianCut.hpp"
+#include "Quantizer.hpp"
+#include "PaletteMapper.hpp"
+#include "SeparableResize.hpp"
 
 #include <string>
+#include <memory>
 #include <opencv2/opencv.hpp>
 
 PRJ_BEGIN
 
 class Resampler {
+public:
+  /// how reduce_color() builds the palette
+  enum QuantizeMode {
+    QUANTIZE_PIXELS,    ///< median cut over every pixel
+    QUANTIZE_HISTOGRAM, ///< median cut over a weighted, reduced-precision histogram
+    QUANTIZE_KMEANS,    ///< histogram median cut refined by k-means
+    QUANTIZE_OCTREE,    ///< single-pass octree
+    QUANTIZE_UNIFORM    ///< uniform levels per channel
+  };
+
 public:
   Resampler(SizeType nc)
-    : _nColors(nc)
+    : _nColors(nc), _quantizer(new MedianCutQuantizer), _fused(true)
   {
   }
 
@@ -21,26 +34,58 @@ public:
   virtual bool open(const std::string & filename)
   {
     _input = cv::imread(filename, CV_LOAD_IMAGE_COLOR);
-
-    if ( _input.data ) {
-      _output = _input.clone();
-      return true;
-    }
-    return false;
+    _output.release();
+    return _input.data != NULL;
   }
 
+  /** use mat as input without copying it
+   *
+   * The pixels are shared with the caller and only read, so they must
+   * not change until the last resample() of this input. Grayscale input
+   * is converted, which is the only case that copies.
+   */
   virtual void load(const cv::Mat & mat)
   {
-    _input = mat.clone();
-    if ( _input.channels() != 3 )
+    _output.release();
+    if ( mat.channels() != 3 )
     {
-      cv::cvtColor(_input, _input, CV_GRAY2BGR);
+      _input.release();
+      cv::cvtColor(mat, _input, CV_GRAY2BGR);
+      return;
     }
-    _output = _input.clone();
+    _input = mat;
+  }
+
+  /// take over mat, which is left empty
+  void load(cv::Mat && mat)
+  {
+    load(static_cast<const cv::Mat &>(mat));
+    mat.release();
+  }
+
+  /// use a BGR buffer owned by the caller, rows are step bytes apart
+  void borrow(const unsigned char * data, SizeType w, SizeType h, SizeType step)
+  {
+    ASSERT(data && step >= 3*w);
+    load(cv::Mat(int(h), int(w), CV_8UC3, const_cast<unsigned char *>(data), step));
   }
 
   virtual void resample(SizeType w, SizeType h) = 0;
 
+  /** resample into out instead of the internal output
+   *
+   * When out already is h x w and CV_8UC3, e.g. a view on a buffer of
+   * the caller, the result is written into its memory, otherwise out is
+   * allocated. The resampler keeps no reference to out afterwards.
+   */
+  void resampleTo(SizeType w, SizeType h, cv::Mat & out)
+  {
+    _output = out;
+    resample(w, h);
+    out = _output;
+    _output.release();
+  }
+
   virtual bool save(const std::string & filename)
   {
     ASSERT(_output.data);
@@ -57,57 +102,156 @@ public:
     return _output;
   }
 
+  /// bits kept per channel by the histogram modes, 5 or 6 are sensible
+  void setQuantizeMode(QuantizeMode mode, SizeType histogram_bits=5)
+  {
+    ASSERT(1 <= histogram_bits && histogram_bits <= max_histogram_bits);
+    switch ( mode )
+    {
+      case QUANTIZE_PIXELS: setQuantizer(std::make_shared<MedianCutQuantizer>()); break;
+      case QUANTIZE_HISTOGRAM: setQuantizer(std::make_shared<HistogramQuantizer>(histogram_bits)); break;
+      case QUANTIZE_KMEANS: setQuantizer(std::make_shared<KMeansQuantizer>(histogram_bits)); break;
+      case QUANTIZE_OCTREE: setQuantizer(std::make_shared<OctreeQuantizer>()); break;
+      case QUANTIZE_UNIFORM: setQuantizer(std::make_shared<UniformQuantizer>()); break;
+    }
+  }
+
+  /// any quantizer, it may be shared with other resamplers
+  void setQuantizer(const std::shared_ptr<const Quantizer> & quantizer)
+  {
+    ASSERT(quantizer);
+    _quantizer = quantizer;
+  }
+
+  const Quantizer & getQuantizer() const
+  {
+    return *_quantizer;
+  }
+
+  /** map every output to this palette instead of quantizing each one
+   *
+   * The nearest-color table is built once here, so a stream of images
+   * shares the exact same colors. An empty palette turns this off.
+   */
+  void setPalette(const std::vector<cv::Vec3b> & palette, SizeType bits=6,
+                  PaletteMapper::Metric metric=PaletteMapper::METRIC_BGR)
+  {
+    _mapper.reset();
+    if ( !palette.empty() )
+    {
+      std::shared_ptr<PaletteMapper> mapper = std::make_shared<PaletteMapper>();
+      mapper->build(palette, bits, metric);
+      _mapper = mapper;
+    }
+  }
+
+  /// share a table that is already built, e.g. between worker threads, NULL turns it off
+  void setPalette(const std::shared_ptr<const PaletteMapper> & mapper)
+  {
+    _mapper = mapper;
+  }
+
+  /// reduce colors while resizing where possible, see resize_reduce()
+  void setFusedQuantize(bool fused)
+  {
+    _fused = fused;
+  }
+
 protected:
-  static void reduce_color(SizeType nColors, cv::Mat & image)
+  /** resize the input into the output and reduce its colors
+   *
+   * With a fixed palette every row is mapped right after it is filtered.
+   * With a BinnedQuantizer its pixels are counted then, and only the
+   * lookup of the palette colors is a pass of its own. Other quantizers
+   * get the finished output. Either way the result is the one of
+   * resizing and calling reduce_color().
+   *
+   * Each row range of the vertical pass counts into a histogram of its
+   * own, so there are as many ranges as partial histograms: one per
+   * thread at most, and fewer when the output has fewer pixels than the
+   * histogram has bins. A small output with a fine histogram is then
+   * filtered by fewer threads, which costs less than clearing and
+   * merging histograms larger than itself.
+   */
+  template <typename Kernel>
+  void resize_reduce(SeparableResize<Kernel> & engine, SizeType w, SizeType h)
   {
-#if 0
-    // naive color quantization
-    if ( nColors )
+    ASSERT(_input.type() == CV_8UC3);
+    if ( _fused && has_palette() )
     {
-      ASSERT(image.channels()==3);
-      typedef unsigned char unchar;
-      unchar d = 256 / nColors * 4;
-      for ( int i=0; i < image.cols; i++ )
-        for ( int j=0; j < image.rows; j++ )
-        {
-          unchar b = image.at<cv::Vec3b>(j, i)[0];
-          unchar g = image.at<cv::Vec3b>(j, i)[1];
-          unchar r = image.at<cv::Vec3b>(j, i)[2];
-          b = b / d * d;
-          g = g / d * d;
-          r = r / d * d;
-          image.at<cv::Vec3b>(j, i) = cv::Vec3b(b, g, r);
-        }
+      engine.resize(_input, _output, w, h, (h+engine.rows_per_task-1)/engine.rows_per_task,
+                    [&](unsigned char * row, SizeType) { _mapper->map(row, row, w); });
+      return;
+    }
+    const BinnedQuantizer * binned = dynamic_cast<const BinnedQuantizer *>(_quantizer.get());
+    if ( !_fused || !_nColors || !binned )
+    {
+      engine.resize(_input, _output, w, h);
+      reduce_color(_nColors, _output);
+      return;
     }
-#endif
 
-#if 1
-    // color quantization using median cut
+    const int bits = binned->histogramBits();
+    const SizeType n_bins = SizeType(1) << (3*bits);
+    const SizeType threads = SizeType(std::max(1, cv::getNumThreads()));
+    const SizeType parts = std::min(histogram_parts(w*h, n_bins, threads), h);
+    std::vector<uint32_t> partials(parts*n_bins, 0);
+    engine.resize(_input, _output, w, h, parts, [&](unsigned char * row, SizeType part)
+    {
+      uint32_t * hist = &partials[part*n_bins];
+      const cv::Vec3b * pixels = reinterpret_cast<const cv::Vec3b *>(row);
+      for ( SizeType i=0; i < w; i++ )
+      {
+        hist[color_bin(pixels[i], bits)]++;
+      }
+    });
+    std::vector<uint32_t> hist(n_bins, 0);
+    for ( SizeType p=0; p < parts; p++ )
+    {
+      for ( SizeType k=0; k < n_bins; k++ )
+      {
+        hist[k] += partials[p*n_bins+k];
+      }
+    }
+
+    std::vector<cv::Vec3b> lut;
+    binned->reduceHistogram(_nColors, hist, lut);
+    if ( lut.empty() ) return;
+    parallel_for(0, h, [&](SizeType j)
+    {
+      cv::Vec3b * row = _output.ptr<cv::Vec3b>(int(j));
+      for ( SizeType i=0; i < w; i++ )
+      {
+        row[i] = lut[color_bin(row[i], bits)];
+      }
+    });
+  }
+
+  bool has_palette() const
+  {
+    return _mapper && !_mapper->empty();
+  }
+
+  void reduce_color(SizeType nColors, cv::Mat & image) const
+  {
+    if ( has_palette() )
+    {
+      _mapper->map(image, image);
+      return;
+    }
     if ( nColors )
     {
-      cvMedianCut cut(nColors);
-      std::vector<cv::Vec3b> data;
-      for ( int i=0; i < image.cols; i++ )
-        for ( int j=0; j < image.rows; j++ )
-        {
-          data.push_back(image.at<cv::Vec3b>(j, i));
-        }
-      cut.process(data);
-      for ( int i=0; i < image.cols; i++ )
-        for ( int j=0; j < image.rows; j++ )
-        {
-          auto res = cut.getResult(i*image.rows+j);
-          //INFO("(%u, %u) = (%u, %u, %u)", i, j, res[0], res[1], res[2]);
-          image.at<cv::Vec3b>(j, i) = res;
-        }
+      _quantizer->reduce(nColors, image);
     }
-#endif
   }
 
 protected:
   cv::Mat _input;
   cv::Mat _output;
   SizeType _nColors; ///< number of colors after resampling
+  std::shared_ptr<const Quantizer> _quantizer;
+  std::shared_ptr<const PaletteMapper> _mapper; ///< fixed palette, if any
+  bool _fused; ///< reduce colors in resize_reduce() while resizing
 
 };
 
@@ -0,0 +1,552 @@
+#ifndef __SEPARABLE_RESIZE_HPP__
+#define __SEPARABLE_RESIZE_HPP__
+
+#include "Config.hpp"
+#include "Parallel.hpp"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <opencv2/opencv.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+PRJ_BEGIN
+
+/** resampling kernels for SeparableResize
+ *
+ * support(fs) is the reach in input pixels and weight(d, fs) the weight
+ * of an input pixel at distance d, where fs >= 1 is the filter scale
+ * (the downscaling factor with antialiasing, 1 without). antialias is
+ * the default of the engine: off for the interpolating kernels, which
+ * then match cv::resize, on for the ones meant for reduction.
+ */
+struct NearestKernel {
+  static const bool antialias = false;
+  static double support(double fs) { return 0.5*fs; }
+  static double weight(double d, double fs)
+  {
+    return -0.5*fs < d && d <= 0.5*fs ? 1.0 : 0.0;
+  }
+};
+
+struct BilinearKernel {
+  static const bool antialias = false;
+  static double support(double fs) { return fs; }
+  static double weight(double d, double fs)
+  {
+    const double x = std::fabs(d/fs);
+    return x < 1.0 ? 1.0-x : 0.0;
+  }
+};
+
+/// Keys cubic with a = -0.75, as cv::INTER_CUBIC
+struct BicubicKernel {
+  static const bool antialias = false;
+  static double support(double fs) { return 2*fs; }
+  static double weight(double d, double fs)
+  {
+    const double a = -0.75;
+    const double x = std::fabs(d/fs);
+    if ( x < 1.0 ) return ((a+2)*x - (a+3))*x*x + 1;
+    if ( x < 2.0 ) return ((a*x - 5*a)*x + 8*a)*x - 4*a;
+    return 0.0;
+  }
+};
+
+/// 8 taps, as cv::INTER_LANCZOS4
+struct LanczosKernel {
+  static const bool antialias = false;
+  static double support(double fs) { return 4*fs; }
+  static double weight(double d, double fs)
+  {
+    const double x = d/fs;
+    if ( x == 0.0 ) return 1.0;
+    if ( std::fabs(x) >= 4.0 ) return 0.0;
+    const double px = CV_PI*x;
+    return 4*std::sin(px)*std::sin(px/4) / (px*px);
+  }
+};
+
+/// Mitchell-Netravali with B = C = 1/3
+struct MitchellKernel {
+  static const bool antialias = true;
+  static double support(double fs) { return 2*fs; }
+  static double weight(double d, double fs)
+  {
+    const double x = std::fabs(d/fs);
+    if ( x < 1.0 ) return (7*x*x*x - 12*x*x + 16.0/3) / 6;
+    if ( x < 2.0 ) return (-7.0/3*x*x*x + 12*x*x - 20*x + 32.0/3) / 6;
+    return 0.0;
+  }
+};
+
+/// exact coverage of the output pixel footprint, as cv::INTER_AREA
+struct AreaKernel {
+  static const bool antialias = true;
+  static double support(double fs) { return 0.5*fs + 0.5; }
+  static double weight(double d, double fs)
+  {
+    return std::max(0.0, std::min(d+0.5, 0.5*fs) - std::max(d-0.5, -0.5*fs));
+  }
+};
+
+/** separable 8-bit resampling with a compile-time kernel
+ *
+ * Per axis, every output pixel gets the same number of taps and int16
+ * weights with 14 fractional bits that sum exactly to one; taps outside
+ * the image are folded onto the edge pixel. The tables of the last
+ * (input, output) size pair of each axis are kept, so a stream of
+ * same-sized frames only pays for them once.
+ *
+ * One pass filters into int16 with 6 fractional bits, the other one from
+ * there into the output; both run on the thread pool. Which axis goes
+ * first depends on the sizes, see resize(). With SSE2 both passes compute
+ * 8 output values per step and multiply two taps per _mm_madd_epi16, the
+ * scalar path does the same integer arithmetic and gives identical results.
+ */
+template <typename Kernel>
+class SeparableResize {
+public:
+  static const int weight_bits = 14;
+  static const int frac_bits = 6; ///< fractional bits between the passes
+
+  SeparableResize(bool antialias = Kernel::antialias)
+    : _antialias(antialias)
+  {
+  }
+
+  /// rows of the output, and of the horizontal pass, per work item
+  static const SizeType rows_per_task = 16;
+
+  /// in is CV_8UC1 to CV_8UC4, out keeps its buffer if it has the right size
+  void resize(const cv::Mat & in, cv::Mat & out, SizeType w, SizeType h)
+  {
+    resize(in, out, w, h, (h+rows_per_task-1)/rows_per_task, [](unsigned char *, SizeType) {});
+  }
+
+  /** resize and hand every output row to sink(row, part) while it is hot
+   *
+   * The output is split into parts ranges of rows, each filled top to
+   * bottom by one thread, so sink may keep state per part, e.g. partial
+   * histograms, or rewrite the row in place.
+   */
+  template <typename RowSink>
+  void resize(const cv::Mat & in, cv::Mat & out, SizeType w, SizeType h,
+              SizeType parts, const RowSink & sink)
+  {
+    ASSERT(in.depth() == CV_8U && in.channels() <= 4);
+    ASSERT(in.cols > 0 && in.rows > 0 && w > 0 && h > 0);
+    ASSERT(0 < parts && parts <= h);
+    const cv::Mat src = in;
+    const int cn = src.channels();
+    axis(_x_axis, src.cols, w);
+    const Axis & ax = lanes(_x_axis, cn);
+    const Axis & ay = axis(_y_axis, src.rows, h);
+    out.create(int(h), int(w), src.type());
+
+    // Filtering along x first only needs the input rows some vertical tap
+    // reads, which skips most of them when a short kernel reduces a lot.
+    // Filtering along y first runs the cheaper contiguous pass over the
+    // full width and leaves the gathers a row per output row, the better
+    // order for large reductions with long kernels. Horizontal products
+    // count double, about what their gathers cost.
+    const SizeType n_rows = ay.used.size();
+    const SizeType row_len = w*cn;
+    const double x_first = double(n_rows)*row_len*ax.taps*2 + double(h)*row_len*ay.taps;
+    const double y_first = double(h)*src.cols*cn*ay.taps + double(h)*row_len*ax.taps*2;
+    if ( y_first < x_first )
+    {
+      parallel_for(0, parts, [&](SizeType part)
+      {
+        const SizeType j1 = (part+1)*h/parts;
+        std::vector<const unsigned char *> rows(ay.taps);
+        std::vector<int16_t> column(src.cols*cn);
+        std::vector<int32_t> pairs;
+        for ( SizeType j=part*h/parts; j < j1; j++ )
+        {
+          for ( int t=0; t < ay.taps; t++ )
+          {
+            rows[t] = src.ptr<unsigned char>(int(ay.first[j]+t));
+          }
+          vertical(&rows[0], &ay.weights[j*ay.taps], ay.taps, &column[0], column.size());
+          unsigned char * row = out.ptr<unsigned char>(int(j));
+          horizontal(&column[0], row, ax, cn, pairs);
+          sink(row, part);
+        }
+      });
+      return;
+    }
+
+    _rows.resize(n_rows*row_len);
+    parallel_for(0, (n_rows+rows_per_task-1)/rows_per_task, [&](SizeType task)
+    {
+      const SizeType k1 = std::min((task+1)*rows_per_task, n_rows);
+      std::vector<int32_t> pairs;
+      for ( SizeType k=task*rows_per_task; k < k1; k++ )
+      {
+        horizontal(src.ptr<unsigned char>(int(ay.used[k])), &_rows[k*row_len], ax, cn, pairs);
+      }
+    });
+
+    parallel_for(0, parts, [&](SizeType part)
+    {
+      const SizeType j1 = (part+1)*h/parts;
+      std::vector<const int16_t *> rows(ay.taps);
+      for ( SizeType j=part*h/parts; j < j1; j++ )
+      {
+        for ( int t=0; t < ay.taps; t++ )
+        {
+          rows[t] = &_rows[ay.slot[ay.first[j]+t-ay.first.front()]*row_len];
+        }
+        unsigned char * row = out.ptr<unsigned char>(int(j));
+        vertical(&rows[0], &ay.weights[j*ay.taps], ay.taps, row, row_len);
+        sink(row, part);
+      }
+    });
+  }
+
+protected:
+  /// weights of one axis for one size pair
+  struct Axis {
+    SizeType in, out;
+    int taps;
+    std::vector<SizeType> first;  ///< first input pixel of every output pixel
+    std::vector<int16_t> weights; ///< taps per output pixel
+    std::vector<SizeType> used;   ///< input pixels some tap reads, increasing
+    std::vector<SizeType> slot;   ///< index into used from first.front() on
+    int cn;                       ///< channels of the tables below, 0 if not built
+    std::vector<int32_t> offset;  ///< first input value of every output value
+    std::vector<int32_t> pairs;   ///< weights of 2 taps, per tap pair 4 output values
+    Axis() : in(0), out(0), taps(0), cn(0) {}
+  };
+
+  /// the tables of a, rebuilt when the size pair changed
+  const Axis & axis(Axis & a, SizeType in, SizeType out)
+  {
+    if ( a.in == in && a.out == out ) return a;
+    a.cn = 0;
+
+    const double scale = double(in) / out;
+    const double fs = _antialias ? std::max(scale, 1.0) : 1.0;
+    const double support = Kernel::support(fs);
+
+    // weights of every output pixel with the taps outside folded onto the
+    // edges; the clamped index never decreases, so each span is contiguous
+    std::vector<SizeType> begin(out);
+    std::vector<std::vector<double> > spans(out);
+    SizeType taps = 1;
+    for ( SizeType o=0; o < out; o++ )
+    {
+      const double center = (o+0.5)*scale - 0.5;
+      const int lo = int(std::floor(center - support));
+      const int hi = int(std::ceil(center + support));
+      std::vector<double> & w = spans[o];
+      for ( int i=lo; i <= hi; i++ )
+      {
+        const double v = Kernel::weight(i - center, fs);
+        if ( v == 0.0 ) continue;
+        const SizeType k = SizeType(std::min(std::max(i, 0), int(in)-1));
+        if ( w.empty() ) begin[o] = k;
+        if ( begin[o] + w.size() <= k ) w.resize(k - begin[o] + 1, 0.0);
+        w[k - begin[o]] += v;
+      }
+      if ( w.empty() )
+      {
+        // no kernel weight at all, take the nearest pixel
+        begin[o] = SizeType(std::min(std::max(int(std::floor(center+0.5)), 0), int(in)-1));
+        w.push_back(1.0);
+      }
+      taps = std::max(taps, SizeType(w.size()));
+    }
+
+    // place the windows, quantize, and give the rounding error to the
+    // largest weight so every sum is exactly one
+    a.in = in;
+    a.out = out;
+    a.taps = int(taps);
+    a.first.resize(out);
+    a.weights.assign(out*taps, 0);
+    for ( SizeType o=0; o < out; o++ )
+    {
+      const std::vector<double> & w = spans[o];
+      double sum = 0;
+      for ( SizeType k=0; k < w.size(); k++ ) sum += w[k];
+      a.first[o] = std::min(begin[o], in - taps);
+      int16_t * q = &a.weights[o*taps + (begin[o] - a.first[o])];
+      int total = 0, largest = 0;
+      for ( SizeType k=0; k < w.size(); k++ )
+      {
+        q[k] = int16_t(std::floor(w[k]/sum*(1 << weight_bits) + 0.5));
+        total += q[k];
+        if ( q[k] > q[largest] ) largest = int(k);
+      }
+      q[largest] += int16_t((1 << weight_bits) - total);
+    }
+
+    const SizeType f0 = a.first.front();
+    std::vector<bool> read(a.first.back() + taps - f0, false);
+    for ( SizeType o=0; o < out; o++ )
+    {
+      std::fill(read.begin() + (a.first[o]-f0), read.begin() + (a.first[o]+taps-f0), true);
+    }
+    a.used.clear();
+    a.slot.assign(read.size(), 0);
+    for ( SizeType k=0; k < read.size(); k++ )
+    {
+      a.slot[k] = a.used.size();
+      if ( read[k] ) a.used.push_back(f0+k);
+    }
+    return a;
+  }
+
+  /** the tables of the horizontal pass over cn channels
+   *
+   * Output value i = o*cn + c reads the input values offset[i] + t*cn. Its
+   * weights are interleaved by blocks of 4 values, so the 4 weight pairs
+   * of a tap pair are one load.
+   */
+  static const Axis & lanes(Axis & a, int cn)
+  {
+    if ( a.cn == cn ) return a;
+    const SizeType n = a.out*cn;
+    const int n_pairs = (a.taps+1)/2;
+    a.cn = cn;
+    a.offset.resize(n);
+    a.pairs.assign((n+3)/4*4*n_pairs, 0);
+    for ( SizeType i=0; i < n; i++ )
+    {
+      const SizeType o = i/cn;
+      const int16_t * q = &a.weights[o*a.taps];
+      a.offset[i] = int32_t(a.first[o]*cn + i%cn);
+      for ( int t=0; t < n_pairs; t++ )
+      {
+        const int16_t second = 2*t+1 < a.taps ? q[2*t+1] : 0;
+        a.pairs[(i/4*n_pairs + t)*4 + i%4] =
+          int32_t(uint32_t(uint16_t(q[2*t])) | (uint32_t(uint16_t(second)) << 16));
+      }
+    }
+    return a;
+  }
+
+  /** one row filtered along x into dst
+   *
+   * With SSE2, 8 output values (pixels times channels) are computed per
+   * step. Every value gathers the inputs of two taps into an int32 lane
+   * and multiplies them with its two weights by _mm_madd_epi16. Unless
+   * the outputs read only a few of the inputs, the row is first rewritten
+   * as pairs (src[i], src[i+cn]), so a gather is one load per lane.
+   */
+  template <typename Src, typename Dst>
+  static void horizontal(const Src * src, Dst * dst, const Axis & ax, int cn,
+                         std::vector<int32_t> & pairs)
+  {
+    const int taps = ax.taps;
+    const SizeType n = ax.first.size()*cn;
+    const int shift = weight_bits + fraction(Src()) - fraction(Dst());
+    SizeType i = 0;
+#if defined(__SSE2__)
+    const SizeType n_in = ax.in*cn;
+    const int n_pairs = (taps+1)/2;
+    const bool direct = 2*n*n_pairs < n_in;
+    if ( !direct )
+    {
+      pairs.resize(n_in);
+      tap_pairs(src, &pairs[0], n_in, cn);
+    }
+    const __m128i round = _mm_set1_epi32(1 << (shift-1));
+    for ( ; i+8 <= n; i+=8 )
+    {
+      const int32_t * offset = &ax.offset[i];
+      const __m128i * weights = reinterpret_cast<const __m128i *>(&ax.pairs[i*n_pairs]);
+      const __m128i * weights_hi = weights + n_pairs;
+      __m128i lo = round, hi = round;
+      for ( int t=0; t < n_pairs; t++ )
+      {
+        __m128i a, b;
+        if ( direct )
+        {
+          const Src * p = src + 2*t*cn;
+          const bool second = 2*t+1 < taps;
+          a = gather(p, offset, cn, second);
+          b = gather(p, offset+4, cn, second);
+        }
+        else
+        {
+          const int32_t * p = &pairs[2*t*cn];
+          a = gather(p, offset);
+          b = gather(p, offset+4);
+        }
+        lo = _mm_add_epi32(lo, _mm_madd_epi16(a, _mm_loadu_si128(weights+t)));
+        hi = _mm_add_epi32(hi, _mm_madd_epi16(b, _mm_loadu_si128(weights_hi+t)));
+      }
+      store(dst+i, _mm_srai_epi32(lo, shift), _mm_srai_epi32(hi, shift));
+    }
+#endif
+    for ( ; i < n; i++ )
+    {
+      const SizeType o = i/cn;
+      const Src * p = src + ax.first[o]*cn + i%cn;
+      const int16_t * q = &ax.weights[o*taps];
+      int32_t sum = 1 << (shift-1);
+      for ( int t=0; t < taps; t++ )
+      {
+        sum += int32_t(q[t]) * p[t*cn];
+      }
+      dst[i] = saturate(sum >> shift, Dst());
+    }
+  }
+
+  /// taps rows to one row filtered along y, 8 values per step with SSE2
+  template <typename Src, typename Dst>
+  static void vertical(const Src * const * rows, const int16_t * q, int taps,
+                       Dst * dst, SizeType n)
+  {
+    const int shift = weight_bits + fraction(Src()) - fraction(Dst());
+    SizeType i = 0;
+#if defined(__SSE2__)
+    const __m128i round = _mm_set1_epi32(1 << (shift-1));
+    for ( ; i+8 <= n; i+=8 )
+    {
+      __m128i lo = round, hi = round;
+      int t = 0;
+      for ( ; t+2 <= taps; t+=2 )
+      {
+        const __m128i a = load(rows[t]+i);
+        const __m128i b = load(rows[t+1]+i);
+        const __m128i weights = pair_weights(q[t], q[t+1]);
+        lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights));
+        hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights));
+      }
+      if ( t < taps )
+      {
+        const __m128i a = load(rows[t]+i);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i weights = _mm_set1_epi32(int(uint16_t(q[t])));
+        lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero), weights));
+        hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, zero), weights));
+      }
+      store(dst+i, _mm_srai_epi32(lo, shift), _mm_srai_epi32(hi, shift));
+    }
+#endif
+    for ( ; i < n; i++ )
+    {
+      int32_t sum = 1 << (shift-1);
+      for ( int t=0; t < taps; t++ )
+      {
+        sum += int32_t(q[t]) * rows[t][i];
+      }
+      dst[i] = saturate(sum >> shift, Dst());
+    }
+  }
+
+  /// fractional bits of a pixel value of the input, output or between the passes
+  static int fraction(unsigned char) { return 0; }
+  static int fraction(int16_t) { return frac_bits; }
+
+  static unsigned char saturate(int32_t v, unsigned char)
+  {
+    return (unsigned char)(std::min(std::max(v, 0), 255));
+  }
+  static int16_t saturate(int32_t v, int16_t)
+  {
+    return int16_t(std::min(std::max(v, -32768), 32767));
+  }
+
+#if defined(__SSE2__)
+  /// two taps in every 32-bit lane, for _mm_madd_epi16
+  static __m128i pair_weights(int16_t w0, int16_t w1)
+  {
+    return _mm_set1_epi32(int(uint32_t(uint16_t(w0)) | (uint32_t(uint16_t(w1)) << 16)));
+  }
+
+  /// 8 values as int16
+  static __m128i load(const unsigned char * p)
+  {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), _mm_setzero_si128());
+  }
+  static __m128i load(const int16_t * p)
+  {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  }
+
+  /// 8 values from two halves of int32, saturated
+  static void store(unsigned char * p, __m128i lo, __m128i hi)
+  {
+    const __m128i packed = _mm_packs_epi32(lo, hi);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(p), _mm_packus_epi16(packed, packed));
+  }
+  static void store(int16_t * p, __m128i lo, __m128i hi)
+  {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm_packs_epi32(lo, hi));
+  }
+
+  /// pairs[i] = (src[i], src[i+cn]) as two int16, zero past the end
+  template <typename Src>
+  static void tap_pairs(const Src * src, int32_t * pairs, SizeType n, int cn)
+  {
+    const SizeType step = 16 / sizeof(Src);
+    __m128i * out = reinterpret_cast<__m128i *>(pairs);
+    SizeType i = 0;
+    for ( ; i+cn+step <= n; i+=step )
+    {
+      out = store_pairs(src+i, src+i+cn, out);
+    }
+    for ( ; i < n; i++ )
+    {
+      const int b = i+cn < n ? src[i+cn] : 0;
+      pairs[i] = int32_t(uint32_t(uint16_t(src[i])) | (uint32_t(uint16_t(b)) << 16));
+    }
+  }
+  static __m128i * store_pairs(const unsigned char * a, const unsigned char * b, __m128i * out)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+    const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+    const __m128i lo = _mm_unpacklo_epi8(x, y), hi = _mm_unpackhi_epi8(x, y);
+    _mm_storeu_si128(out++, _mm_unpacklo_epi8(lo, zero));
+    _mm_storeu_si128(out++, _mm_unpackhi_epi8(lo, zero));
+    _mm_storeu_si128(out++, _mm_unpacklo_epi8(hi, zero));
+    _mm_storeu_si128(out++, _mm_unpackhi_epi8(hi, zero));
+    return out;
+  }
+  static __m128i * store_pairs(const int16_t * a, const int16_t * b, __m128i * out)
+  {
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+    const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+    _mm_storeu_si128(out++, _mm_unpacklo_epi16(x, y));
+    _mm_storeu_si128(out++, _mm_unpackhi_epi16(x, y));
+    return out;
+  }
+
+  /// the pairs at 4 offsets
+  static __m128i gather(const int32_t * pairs, const int32_t * offset)
+  {
+    return _mm_set_epi32(pairs[offset[3]], pairs[offset[2]], pairs[offset[1]], pairs[offset[0]]);
+  }
+
+  /// the same from the row itself, the second tap only if there is one
+  template <typename Src>
+  static __m128i gather(const Src * p, const int32_t * offset, int cn, bool second)
+  {
+    const __m128i a = _mm_set_epi32(uint16_t(p[offset[3]]), uint16_t(p[offset[2]]),
+                                    uint16_t(p[offset[1]]), uint16_t(p[offset[0]]));
+    if ( !second ) return a;
+    p += cn;
+    const __m128i b = _mm_set_epi32(uint16_t(p[offset[3]]), uint16_t(p[offset[2]]),
+                                    uint16_t(p[offset[1]]), uint16_t(p[offset[0]]));
+    return _mm_or_si128(a, _mm_slli_epi32(b, 16));
+  }
+#endif
+
+protected:
+  bool _antialias;
+  Axis _x_axis, _y_axis;
+  std::vector<int16_t> _rows; ///< output of the horizontal pass
+};
+
+PRJ_END
+
+#endif //__SEPARABLE_RESIZE_HPP__
@@ -0,0 +1,180 @@
+#ifndef __SLIC_KERNEL_HPP__
+#define __SLIC_KERNEL_HPP__
+
+#include "Config.hpp"
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+PRJ_BEGIN
+
+/** step of 16-bit fixed-point Lab planes
+ *
+ * L in [0,100] and a, b of 8-bit sRGB colors (within +-110) all fit in
+ * int16 at this step, and multiplying by a power of two is exact, so a
+ * fixed-point plane reads back exactly as the rounded float value.
+ */
+const float lab_fixed_step = 1.0f/256;
+
+inline float lab_value(float v)
+{
+  return v;
+}
+
+inline float lab_value(int16_t v)
+{
+  return float(v) * lab_fixed_step;
+}
+
+#if defined(__AVX__)
+inline __m256 lab_load8(const float * p)
+{
+  return _mm256_loadu_ps(p);
+}
+
+inline __m256 lab_load8(const int16_t * p)
+{
+  const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  const __m256i w = _mm256_insertf128_si256(_mm256_castsi128_si256(_mm_cvtepi16_epi32(v)),
+                                            _mm_cvtepi16_epi32(_mm_srli_si128(v, 8)), 1);
+  return _mm256_mul_ps(_mm256_cvtepi32_ps(w), _mm256_set1_ps(lab_fixed_step));
+}
+#endif
+
+#if defined(__SSE2__)
+inline __m128 lab_load4(const float * p)
+{
+  return _mm_loadu_ps(p);
+}
+
+inline __m128 lab_load4(const int16_t * p)
+{
+  __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p));
+  v = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+  return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(lab_fixed_step));
+}
+#endif
+
+/** SLIC distance between a pixel and a superpixel
+ *
+ * This is the scalar reference of slic_span(), the vector paths evaluate
+ * the very same float expression so both give identical results.
+ */
+inline float slic_distance(float L, float a, float b, float dx, float dy,
+                           const float color[3], float weight)
+{
+  const float dL = L - color[0];
+  const float da = a - color[1];
+  const float db = b - color[2];
+  const float color_error = std::sqrt(dL*dL + da*da + db*db);
+  const float dist_error = std::sqrt(dx*dx + dy*dy);
+  return color_error + weight*dist_error;
+}
+
+/** score pixels [x0, x1) of one row against one superpixel
+ *
+ * L, a, b are the planar Lab rows, float or fixed point (T = int16_t),
+ * dist and label are the best distance and label of each pixel in that
+ * row. Fixed-point pixels are widened to float on load, the distance is
+ * then the same float expression. A pixel takes the superpixel only
+ * if it is strictly closer, so earlier candidates win ties.
+ *
+ * @param center superpixel center in pixel coordinates
+ * @param row    y coordinate of the row
+ * @param weight spatial weight of the distance
+ */
+template <typename T>
+inline void slic_span(const T * L, const T * a, const T * b,
+                      float * dist, uint32_t * label,
+                      SizeType x0, SizeType x1, SizeType row,
+                      const float center[2], const float color[3],
+                      float weight, uint32_t id)
+{
+  const float dy = float(row) - center[1];
+  SizeType x = x0;
+#if defined(__AVX__)
+  {
+    const __m256 vL = _mm256_set1_ps(color[0]);
+    const __m256 va = _mm256_set1_ps(color[1]);
+    const __m256 vb = _mm256_set1_ps(color[2]);
+    const __m256 vdy2 = _mm256_set1_ps(dy*dy);
+    const __m256 vcx = _mm256_set1_ps(center[0]);
+    const __m256 vw = _mm256_set1_ps(weight);
+    const __m256 vid = _mm256_castsi256_ps(_mm256_set1_epi32(int(id)));
+    const __m256 step = _mm256_set1_ps(8.0f);
+    __m256 vx = _mm256_setr_ps(float(x), float(x+1), float(x+2), float(x+3),
+                               float(x+4), float(x+5), float(x+6), float(x+7));
+    for ( ; x+8 <= x1; x+=8, vx=_mm256_add_ps(vx, step) )
+    {
+      const __m256 dL = _mm256_sub_ps(lab_load8(L+x), vL);
+      const __m256 da = _mm256_sub_ps(lab_load8(a+x), va);
+      const __m256 db = _mm256_sub_ps(lab_load8(b+x), vb);
+      const __m256 dx = _mm256_sub_ps(vx, vcx);
+      const __m256 c2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dL, dL),
+                                                    _mm256_mul_ps(da, da)),
+                                      _mm256_mul_ps(db, db));
+      const __m256 p2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), vdy2);
+      const __m256 d = _mm256_add_ps(_mm256_sqrt_ps(c2),
+                                     _mm256_mul_ps(vw, _mm256_sqrt_ps(p2)));
+      const __m256 best = _mm256_loadu_ps(dist+x);
+      const __m256 mask = _mm256_cmp_ps(d, best, _CMP_LT_OQ);
+      _mm256_storeu_ps(dist+x, _mm256_blendv_ps(best, d, mask));
+      float * lp = reinterpret_cast<float *>(label+x);
+      _mm256_storeu_ps(lp, _mm256_blendv_ps(_mm256_loadu_ps(lp), vid, mask));
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  {
+    const __m128 vL = _mm_set1_ps(color[0]);
+    const __m128 va = _mm_set1_ps(color[1]);
+    const __m128 vb = _mm_set1_ps(color[2]);
+    const __m128 vdy2 = _mm_set1_ps(dy*dy);
+    const __m128 vcx = _mm_set1_ps(center[0]);
+    const __m128 vw = _mm_set1_ps(weight);
+    const __m128i vid = _mm_set1_epi32(int(id));
+    const __m128 step = _mm_set1_ps(4.0f);
+    __m128 vx = _mm_setr_ps(float(x), float(x+1), float(x+2), float(x+3));
+    for ( ; x+4 <= x1; x+=4, vx=_mm_add_ps(vx, step) )
+    {
+      const __m128 dL = _mm_sub_ps(lab_load4(L+x), vL);
+      const __m128 da = _mm_sub_ps(lab_load4(a+x), va);
+      const __m128 db = _mm_sub_ps(lab_load4(b+x), vb);
+      const __m128 dx = _mm_sub_ps(vx, vcx);
+      const __m128 c2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dL, dL),
+                                              _mm_mul_ps(da, da)),
+                                   _mm_mul_ps(db, db));
+      const __m128 p2 = _mm_add_ps(_mm_mul_ps(dx, dx), vdy2);
+      const __m128 d = _mm_add_ps(_mm_sqrt_ps(c2),
+                                  _mm_mul_ps(vw, _mm_sqrt_ps(p2)));
+      const __m128 best = _mm_loadu_ps(dist+x);
+      const __m128 mask = _mm_cmplt_ps(d, best);
+      _mm_storeu_ps(dist+x, _mm_or_ps(_mm_and_ps(mask, d),
+                                      _mm_andnot_ps(mask, best)));
+      __m128i * lp = reinterpret_cast<__m128i *>(label+x);
+      const __m128i imask = _mm_castps_si128(mask);
+      _mm_storeu_si128(lp, _mm_or_si128(_mm_and_si128(imask, vid),
+                                        _mm_andnot_si128(imask, _mm_loadu_si128(lp))));
+    }
+  }
+#endif
+  for ( ; x < x1; x++ )
+  {
+    const float d = slic_distance(lab_value(L[x]), lab_value(a[x]), lab_value(b[x]),
+                                  float(x)-center[0], dy, color, weight);
+    if ( d < dist[x] )
+    {
+      dist[x] = d;
+      label[x] = id;
+    }
+  }
+}
+
+PRJ_END
+
+#endif //__SLIC_KERNEL_HPP__
@@ -0,0 +1,85 @@
+#ifndef __SYMMETRIC_EIGEN_HPP__
+#define __SYMMETRIC_EIGEN_HPP__
+
+#include "Config.hpp"
+
+#include <cmath>
+
+PRJ_BEGIN
+
+/** principal eigenpair of a symmetric 3x3 matrix
+ *
+ * The matrix is given by its upper triangle {xx, xy, xz, yy, yz, zz}.
+ * Cyclic Jacobi rotations diagonalize it, which for 3x3 converges in a
+ * handful of sweeps and stays accurate for (near) repeated eigenvalues.
+ * On return value holds the largest eigenvalue and vector its unit
+ * eigenvector.
+ */
+inline void symmetric_eigen3(const double m[6], double & value, double vector[3])
+{
+  double a[3][3] = {{m[0], m[1], m[2]},
+                    {m[1], m[3], m[4]},
+                    {m[2], m[4], m[5]}};
+  double v[3][3] = {{1, 0, 0},
+                    {0, 1, 0},
+                    {0, 0, 1}};
+  static const int pairs[3][2] = {{0, 1}, {0, 2}, {1, 2}};
+
+  for ( int sweep=0; sweep < 32; sweep++ )
+  {
+    const double off = a[0][1]*a[0][1] + a[0][2]*a[0][2] + a[1][2]*a[1][2];
+    const double diag = a[0][0]*a[0][0] + a[1][1]*a[1][1] + a[2][2]*a[2][2];
+    if ( off <= 1e-30*diag || off == 0 ) break;
+
+    for ( int r=0; r < 3; r++ )
+    {
+      const int p = pairs[r][0];
+      const int q = pairs[r][1];
+      if ( a[p][q] == 0 ) continue;
+
+      // rotation angle that zeroes a[p][q]
+      const double theta = (a[q][q]-a[p][p]) / (2*a[p][q]);
+      const double t = (theta >= 0 ? 1.0 : -1.0)
+                     / (std::abs(theta) + std::sqrt(theta*theta+1));
+      const double c = 1 / std::sqrt(t*t+1);
+      const double s = t*c;
+
+      for ( int k=0; k < 3; k++ )
+      {
+        const double akp = a[k][p];
+        const double akq = a[k][q];
+        a[k][p] = c*akp - s*akq;
+        a[k][q] = s*akp + c*akq;
+      }
+      for ( int k=0; k < 3; k++ )
+      {
+        const double apk = a[p][k];
+        const double aqk = a[q][k];
+        a[p][k] = c*apk - s*aqk;
+        a[q][k] = s*apk + c*aqk;
+      }
+      for ( int k=0; k < 3; k++ )
+      {
+        const double vkp = v[k][p];
+        const double vkq = v[k][q];
+        v[k][p] = c*vkp - s*vkq;
+        v[k][q] = s*vkp + c*vkq;
+      }
+    }
+  }
+
+  int best = 0;
+  for ( int i=1; i < 3; i++ )
+  {
+    if ( a[i][i] > a[best][best] ) best = i;
+  }
+  value = a[best][best];
+  for ( int k=0; k < 3; k++ )
+  {
+    vector[k] = v[k][best];
+  }
+}
+
+PRJ_END
+
+#endif //__SYMMETRIC_EIGEN_HPP__
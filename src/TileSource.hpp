@@ -0,0 +1,200 @@
+#ifndef __TILE_SOURCE_HPP__
+#define __TILE_SOURCE_HPP__
+
+#include "Config.hpp"
+
+#include <string>
+#include <cctype>
+#include <opencv2/opencv.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+PRJ_BEGIN
+
+/** row-band access to a BGR image that need not be resident in memory */
+class TileSource {
+public:
+  TileSource()
+    : _width(0), _height(0)
+  {
+  }
+
+  virtual ~TileSource() {}
+
+  SizeType width() const
+  {
+    return _width;
+  }
+
+  SizeType height() const
+  {
+    return _height;
+  }
+
+  /// rows [y0, y0+rows) as CV_8UC3, out may end up sharing the source data
+  virtual void read(SizeType y0, SizeType rows, cv::Mat & out) = 0;
+
+  /// a single pixel, safe to call from several threads at once
+  virtual cv::Vec3b pixel(SizeType x, SizeType y) const = 0;
+
+protected:
+  SizeType _width;
+  SizeType _height;
+
+};
+
+/// an image that is already in memory, bands are views without copies
+class MatTileSource : public TileSource {
+public:
+  MatTileSource()
+  {
+  }
+
+  MatTileSource(const cv::Mat & image)
+    : _image(image)
+  {
+    ASSERT(image.type() == CV_8UC3);
+    _width = image.cols;
+    _height = image.rows;
+  }
+
+  virtual void read(SizeType y0, SizeType rows, cv::Mat & out)
+  {
+    out = _image.rowRange(y0, y0+rows);
+  }
+
+  virtual cv::Vec3b pixel(SizeType x, SizeType y) const
+  {
+    return _image.at<cv::Vec3b>(y, x);
+  }
+
+protected:
+  cv::Mat _image;
+
+};
+
+/** a memory-mapped binary PPM (P6, maxval 255)
+ *
+ * Only the pages of the bands being read are brought in by the kernel,
+ * so arbitrarily large scans can be streamed.
+ */
+class PPMTileSource : public TileSource {
+public:
+  PPMTileSource()
+    : _map(NULL), _map_size(0), _pixels(NULL)
+  {
+  }
+
+  virtual ~PPMTileSource()
+  {
+    close();
+  }
+
+  bool open(const std::string & filename)
+  {
+    close();
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if ( fd < 0 ) return false;
+    struct stat st;
+    if ( fstat(fd, &st) == 0 && st.st_size > 0 )
+    {
+      _map_size = st.st_size;
+      void * map = mmap(NULL, _map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      _map = map == MAP_FAILED ? NULL : static_cast<const unsigned char *>(map);
+    }
+    ::close(fd);
+    if ( !_map || !parse_header() )
+    {
+      close();
+      return false;
+    }
+    madvise(const_cast<unsigned char *>(_map), _map_size, MADV_SEQUENTIAL);
+    return true;
+  }
+
+  void close()
+  {
+    if ( _map )
+    {
+      munmap(const_cast<unsigned char *>(_map), _map_size);
+    }
+    _map = NULL;
+    _map_size = 0;
+    _pixels = NULL;
+    _width = _height = 0;
+  }
+
+  virtual void read(SizeType y0, SizeType rows, cv::Mat & out)
+  {
+    ASSERT(y0+rows <= _height);
+    out.create(rows, _width, CV_8UC3);
+    for ( SizeType j=0; j < rows; j++ )
+    {
+      const unsigned char * rgb = _pixels + (y0+j)*_width*3;
+      unsigned char * bgr = out.ptr<unsigned char>(j);
+      for ( SizeType i=0; i < _width; i++ )
+      {
+        bgr[3*i+0] = rgb[3*i+2];
+        bgr[3*i+1] = rgb[3*i+1];
+        bgr[3*i+2] = rgb[3*i+0];
+      }
+    }
+  }
+
+  virtual cv::Vec3b pixel(SizeType x, SizeType y) const
+  {
+    const unsigned char * rgb = _pixels + (y*_width+x)*3;
+    return cv::Vec3b(rgb[2], rgb[1], rgb[0]);
+  }
+
+protected:
+  /// reads one header field, skipping whitespace and comments
+  bool parse_field(SizeType & pos, SizeType & value) const
+  {
+    while ( pos < _map_size )
+    {
+      if ( _map[pos] == '#' )
+      {
+        while ( pos < _map_size && _map[pos] != '\n' ) pos++;
+      }
+      else if ( isspace(_map[pos]) )
+      {
+        pos++;
+      }
+      else break;
+    }
+    if ( pos >= _map_size || !isdigit(_map[pos]) ) return false;
+    value = 0;
+    while ( pos < _map_size && isdigit(_map[pos]) )
+    {
+      value = value*10 + (_map[pos++]-'0');
+    }
+    return true;
+  }
+
+  bool parse_header()
+  {
+    if ( _map_size < 2 || _map[0] != 'P' || _map[1] != '6' ) return false;
+    SizeType pos = 2, maxval = 0;
+    if ( !parse_field(pos, _width) || !parse_field(pos, _height) ||
+         !parse_field(pos, maxval) || maxval != 255 ) return false;
+    // exactly one whitespace byte separates the header from the pixels
+    pos++;
+    if ( pos + _width*_height*3 > _map_size ) return false;
+    _pixels = _map + pos;
+    return true;
+  }
+
+protected:
+  const unsigned char * _map;
+  SizeType _map_size;
+  const unsigned char * _pixels;
+
+};
+
+PRJ_END
+
+#endif //__TILE_SOURCE_HPP__
@@ -0,0 +1,147 @@
+#include "TiledAbstractionResampler.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+
+USE_PRJ_NAMESPACE;
+
+void TiledAbstractionResampler::resample(TileSource & source, SizeType w, SizeType h,
+                                         const ConvergencePolicy & policy)
+{
+  _source = &source;
+  resample(w, h, policy);
+  _source = NULL;
+}
+
+void TiledAbstractionResampler::visualizeSuperpixel(cv::Mat & output, SizeType /*scale*/)
+{
+  WARN("visualizeSuperpixel() is not available in tiled mode");
+  output.release();
+}
+
+void TiledAbstractionResampler::prepare_input()
+{
+  INFO("prepare_input(): tiled, %lu rows per band", _band_rows);
+  ASSERT(_band_rows > 0);
+
+  if ( !_source )
+  {
+    _input_source = MatTileSource(_input);
+    _source = &_input_source;
+  }
+  if ( _pyramid_levels )
+  {
+    WARN("pyramid levels are ignored in tiled mode");
+  }
+  if ( _fixed_point_lab )
+  {
+    WARN("fixed-point Lab is ignored in tiled mode");
+  }
+
+  // no full-resolution state at all, only the geometry of the input
+  _level = 0;
+  _pyramid.clear();
+  for ( int c=0; c < 3; c++ )
+  {
+    _lab_planes[c].release();
+  }
+  std::vector<LabelType>().swap(_pixel_map);
+  std::vector<float>().swap(_distance_map);
+  set_input_size(_source->width(), _source->height());
+  _remapped = false;
+}
+
+void TiledAbstractionResampler::remap_pixels()
+{
+  INFO("remap_pixels(): deferred to the band pass");
+
+  // labels are only needed while their band is resident, so the actual
+  // assignment happens inside update_superpixels()
+  prepare_search_windows();
+  _remapped = true;
+}
+
+void TiledAbstractionResampler::update_superpixels()
+{
+  INFO("update_superpixels(): tiled");
+
+  static const SizeType tile_rows = 16;
+  const Real sy = (Real)_input_height / _output_height;
+
+  // Bands are cut at _band_rows whatever the stripes are, so a stripe may
+  // span several bands. Its rows are still summed by one thread in
+  // increasing order, band after band, and the merge is the same as for
+  // the in-memory path. Labels are not kept between bands or iterations:
+  // every row starts from its grid cells, which is what a pixel outside
+  // all search windows keeps (the in-memory path keeps its previous label
+  // instead).
+  SizeType s0 = 0;
+  for ( SizeType y0=0; y0 < _input_height; y0+=_band_rows )
+  {
+    const SizeType y1 = std::min(y0+_band_rows, _input_height);
+    load_band(y0, y1);
+
+    const SizeType n_tiles = (y1-y0+tile_rows-1) / tile_rows;
+    parallel_for(0, n_tiles, [&](SizeType tile)
+    {
+      const SizeType j1 = std::min(y0+(tile+1)*tile_rows, y1);
+      for ( SizeType j=y0+tile*tile_rows; j < j1; j++ )
+      {
+        const SizeType r = j-y0;
+        const SizeType cy = std::min(SizeType(j/sy), _output_height-1);
+        LabelType * label = &_band_labels[r*_input_width];
+        for ( SizeType ci=0; ci < _output_width; ci++ )
+        {
+          std::fill(label+_cell_x[ci], label+_cell_x[ci+1],
+                    LabelType(cy*_output_width+ci));
+        }
+        if ( _remapped )
+        {
+          remap_row(j, _band_planes[0].ptr<float>(r), _band_planes[1].ptr<float>(r),
+                    _band_planes[2].ptr<float>(r), &_band_distance[r*_input_width], label);
+        }
+      }
+    });
+
+    // the stripes overlapping the band, s0 is the one holding y0
+    SizeType s1 = s0;
+    for ( ; s1 < _n_stripes; s1++ )
+    {
+      SizeType sy0, sy1;
+      stripe_bounds(s1, sy0, sy1);
+      if ( sy0 >= y1 ) break;
+    }
+    parallel_for(s0, s1, [&](SizeType s)
+    {
+      SizeType sy0, sy1;
+      stripe_bounds(s, sy0, sy1);
+      if ( sy0 >= y0 ) clear_stripe(s);
+      const SizeType j1 = std::min(sy1, y1);
+      for ( SizeType j=std::max(sy0, y0); j < j1; j++ )
+      {
+        const SizeType r = j-y0;
+        accumulate_row(s, j, _band_planes[0].ptr<float>(r), _band_planes[1].ptr<float>(r),
+                       _band_planes[2].ptr<float>(r), &_band_labels[r*_input_width]);
+      }
+    });
+    // a stripe ending inside the band is done
+    SizeType last_y0, last_y1;
+    stripe_bounds(s1-1, last_y0, last_y1);
+    s0 = last_y1 > y1 ? s1-1 : s1;
+  }
+
+  resolve_superpixels();
+}
+
+cv::Vec3f TiledAbstractionResampler::sample_input(SizeType x, SizeType y) const
+{
+  return bgr_to_lab(_source->pixel(x, y));
+}
+
+void TiledAbstractionResampler::load_band(SizeType y0, SizeType y1)
+{
+  _source->read(y0, y1-y0, _band_bgr);
+  bgr_to_lab_planes(_band_bgr, _band_planes[0], _band_planes[1], _band_planes[2]);
+  _band_distance.resize((y1-y0)*_input_width);
+  _band_labels.resize((y1-y0)*_input_width);
+}
@@ -0,0 +1,57 @@
+/**
+ * Bounded-memory variant of AbstractionResampler for very large inputs.
+ *
+ * The input is streamed from a TileSource in bands of rows every
+ * iteration. Only per-superpixel state and one band of Lab pixels stay
+ * resident, so the peak memory depends on the band size and the output
+ * size but not on the input size.
+ */
+#ifndef __TILED_ABSTRACTION_RESAMPLER_HPP__
+#define __TILED_ABSTRACTION_RESAMPLER_HPP__
+
+#include "AbstractionResampler.hpp"
+#include "TileSource.hpp"
+
+PRJ_BEGIN
+
+class TiledAbstractionResampler : public AbstractionResampler {
+public:
+  /// band_rows bounds the input rows held at once, about 20 bytes per pixel
+  TiledAbstractionResampler(SizeType nc, SizeType band_rows=512)
+    : AbstractionResampler(nc), _band_rows(band_rows), _source(NULL)
+  {
+  }
+
+  virtual ~TiledAbstractionResampler() {}
+
+  using AbstractionResampler::resample;
+  void resample(TileSource & source, SizeType w, SizeType h,
+                const ConvergencePolicy & policy = ConvergencePolicy());
+
+  /// not available, the pixel labels are never kept for the whole image
+  virtual void visualizeSuperpixel(cv::Mat & output, SizeType scale=1);
+
+protected:
+  virtual void prepare_input();
+  virtual void remap_pixels();
+  virtual void update_superpixels();
+  virtual cv::Vec3f sample_input(SizeType x, SizeType y) const;
+  void load_band(SizeType y0, SizeType y1);
+
+protected:
+  SizeType _band_rows;
+  TileSource * _source;
+  MatTileSource _input_source; ///< used when resampling the loaded _input
+  bool _remapped; ///< false until the first remap_pixels()
+
+  // the current band of input rows
+  cv::Mat _band_bgr;
+  cv::Mat _band_planes[3];
+  std::vector<float> _band_distance;
+  std::vector<LabelType> _band_labels;
+
+};
+
+PRJ_END
+
+#endif //__TILED_ABSTRACTION_RESAMPLER_HPP__
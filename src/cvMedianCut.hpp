@@ -2,6 +2,7 @@
 #define __CV_MEDIAN_CUT_HPP__
 
 #include "MedianCut.hpp"
+#include "Parallel.hpp"
 
 #include <opencv2/opencv.hpp>
 
@@ -23,70 +24,110 @@ public:
 protected:
   virtual void split(const Cluster & c, Cluster & c1, Cluster & c2)
   {
-    // first, determine which dimension to split
-    SizeType component = 0;
-    unchar max_l = c.getMaximum(0)[0] - c.getMinimum(0)[0];
-    for ( SizeType i=1; i < 3; i++ )
+    // first, the dimension to split was chosen with the bounding box
+    const SizeType component = c.split_component;
+    const std::vector<T> & data = *_data;
+    SizeType * const first = &_indices[c.begin];
+    SizeType * const last = first + c.size();
+
+    const auto less = [&](SizeType i, SizeType j)
     {
-      unchar l = c.getMaximum(i)[i] - c.getMinimum(i)[i];
-      if ( l > max_l )
-      {
-        max_l = l;
-        component = i;
-      }
-    }
+      return data[i][component] < data[j][component];
+    };
 
     // second, find median of that dimension
-    std::vector<unchar> t;
-    for ( SizeType i=0; i < c.indices.size(); i++ )
-    {
-      t.push_back((*_data)[c.indices[i]][component]);
-    }
 #ifndef USE_MEAN
-    unchar median = findMedian<unchar>(t, 0, t.size());
-#else
-    SizeType median = 0;
-    for ( SizeType i=0; i < t.size(); i++ )
+    unchar median;
+    if ( !_weights )
     {
-      median += t[i];
+      SizeType * const middle = first + c.size()/2;
+      std::nth_element(first, middle, last, less);
+      median = data[*middle][component];
     }
-    median /= t.size();
-#endif
-
-    // last, split according to the median
-    for ( SizeType i=0; i < c.indices.size(); i++ )
+    else
     {
-      if ( (*_data)[c.indices[i]][component] >= median )
+      // weighted elements are few (e.g. histogram bins), so just sort
+      std::sort(first, last, less);
+      SizeType total = 0;
+      for ( SizeType * i=first; i < last; i++ )
       {
-        c1.indices.push_back(c.indices[i]);
+        total += weight(*i);
       }
-      else
+      SizeType * i = first;
+      for ( SizeType sum=weight(*i); sum <= total/2; sum+=weight(*i) )
       {
-        c2.indices.push_back(c.indices[i]);
+        i++;
       }
+      median = data[*i][component];
     }
+#else
+    SizeType median = 0, total = 0;
+    for ( SizeType * i=first; i < last; i++ )
+    {
+      median += weight(*i) * data[*i][component];
+      total += weight(*i);
+    }
+    median /= total;
+#endif
+
+    // last, split according to the median, in place; if the median is
+    // the smallest value, move it to the lower side so neither is empty
+    const bool at_minimum = median <= c.minimum[component];
+    SizeType * const split = std::partition(first, last, [&](SizeType i)
+    {
+      return at_minimum ? data[i][component] > median : data[i][component] >= median;
+    });
+    c1 = Cluster(c.begin, c.begin + (split-first));
+    c2 = Cluster(c1.end, c.end);
+  }
+
+  virtual void split_nodes(const std::vector<SizeType> & batch)
+  {
+    parallel_for(0, batch.size(), [&](SizeType i)
+    {
+      split_node(batch[i]);
+    });
   }
 
   virtual void generate_results()
   {
+    _palette.resize(_clusters.size());
+    _labels.resize(_data->size());
     for ( SizeType i=0; i < _clusters.size(); i++ )
     {
-      SizeType size = _clusters[i].indices.size();
+      const Cluster & c = _clusters[i];
+      SizeType size = c.size();
       SizeType b = 0;
       SizeType g = 0;
       SizeType r = 0;
-      for ( SizeType j=0; j < size; j++ )
+      if ( _weights )
+      {
+        size = 0;
+        for ( SizeType j=c.begin; j < c.end; j++ )
+        {
+          const SizeType w = weight(_indices[j]);
+          b += w * (*_data)[_indices[j]][0];
+          g += w * (*_data)[_indices[j]][1];
+          r += w * (*_data)[_indices[j]][2];
+          size += w;
+        }
+      }
+      else
       {
-        b += (*_data)[_clusters[i].indices[j]][0];
-        g += (*_data)[_clusters[i].indices[j]][1];
-        r += (*_data)[_clusters[i].indices[j]][2];
+        for ( SizeType j=c.begin; j < c.end; j++ )
+        {
+          b += (*_data)[_indices[j]][0];
+          g += (*_data)[_indices[j]][1];
+          r += (*_data)[_indices[j]][2];
+        }
       }
       b /= size;
       g /= size;
       r /= size;
-      for ( SizeType j=0; j < size; j++ )
+      _palette[i] = T(b,g,r);
+      for ( SizeType j=c.begin; j < c.end; j++ )
       {
-        _results[_clusters[i].indices[j]] =  T(b,g,r);
+        _labels[_indices[j]] = i;
       }
     }
   }
@@ -21,7 +21,19 @@ int main(int argc, char * argv[])
   SizeType w1 = w0 / 12;
   SizeType h1 = h0 / 12;
 
-  resampler.resample(w1, h1);
+  // optional wall-clock budget in seconds
+  AbstractionResampler::ConvergencePolicy policy;
+  if ( argc > 2 )
+  {
+    policy.time_budget = atof(argv[2]);
+  }
+  // optional number of coarse-to-fine pyramid levels
+  if ( argc > 3 )
+  {
+    resampler.setPyramidLevels(atoi(argv[3]));
+  }
+  resampler.resample(w1, h1, policy);
+  INFO("%lu iterations, converged = %d", resampler.getIterations(), resampler.isConverged());
 
   cv::namedWindow("Origin", CV_WINDOW_AUTOSIZE);
   cv::imshow("Origin", resampler.getInput());
@@ -0,0 +1,27 @@
+#include "TiledAbstractionResampler.hpp"
+
+USE_PRJ_NAMESPACE;
+
+int main(int argc, char * argv[])
+{
+  if ( argc < 2 )
+  {
+    INFO("Please give me a binary PPM (P6) image.");
+    return -1;
+  }
+
+  // the image is memory-mapped and streamed, never loaded as a whole
+  PPMTileSource source;
+  ASSERT_MSG(source.open(argv[1]), "No image data");
+
+  SizeType w1 = source.width() / 12;
+  SizeType h1 = source.height() / 12;
+  SizeType band_rows = argc > 2 ? atoi(argv[2]) : 512;
+
+  TiledAbstractionResampler resampler(8, band_rows);
+  resampler.resample(source, w1, h1);
+  INFO("%lu iterations, converged = %d", resampler.getIterations(), resampler.isConverged());
+  resampler.save("abstracted_small.png");
+
+  return 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * Tiled abstraction at anisotropic scales.
+ *
+ *   AbstractTiledAnisotropic [band rows]
+ *
+ * 1000x100 and 100x1000 to 10x10 give search windows much narrower than
+ * the grid cells along the long axis, so many pixels are in no window
+ * at all. Those must keep a label of their own band; a stale one trips
+ * the stripe bounds in accumulate_row(). Each size is run with the given
+ * band height and with a single band, and checked for an output of the
+ * right size and palette.
+ */
+#include "TiledAbstractionResampler.hpp"
+
+#include <set>
+#include <cstdlib>
+
+USE_PRJ_NAMESPACE;
+
+static cv::Mat make_image(int w, int h)
+{
+  cv::Mat image(h, w, CV_8UC3);
+  cv::RNG rng(7);
+  for ( int j=0; j < h; j++ )
+  {
+    cv::Vec3b * row = image.ptr<cv::Vec3b>(j);
+    for ( int i=0; i < w; i++ )
+    {
+      row[i] = cv::Vec3b(cv::saturate_cast<uchar>(255*i/w + rng.uniform(-8, 8)),
+                         cv::saturate_cast<uchar>(255*j/h + rng.uniform(-8, 8)),
+                         (i/37 + j/23) % 2 ? 200 : 40);
+    }
+  }
+  return image;
+}
+
+static bool run(const cv::Mat & image, SizeType band_rows)
+{
+  const SizeType n_colors = 8;
+  TiledAbstractionResampler resampler(n_colors, band_rows);
+  AbstractionResampler::ConvergencePolicy policy;
+  policy.max_iterations = 30;
+  MatTileSource source(image);
+  resampler.resample(source, 10, 10, policy);
+
+  const cv::Mat & output = resampler.getOutput();
+  std::set<int> colors;
+  for ( int j=0; j < output.rows; j++ )
+  {
+    const cv::Vec3b * row = output.ptr<cv::Vec3b>(j);
+    for ( int i=0; i < output.cols; i++ )
+    {
+      colors.insert(row[i][0] | (row[i][1] << 8) | (row[i][2] << 16));
+    }
+  }
+  const bool ok = output.cols == 10 && output.rows == 10 && colors.size() <= n_colors;
+  INFO("%dx%d, %lu band rows: %lu iterations, %lu colors, %s", image.cols, image.rows,
+       band_rows, resampler.getIterations(), SizeType(colors.size()), ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main(int argc, char * argv[])
+{
+  const SizeType band_rows = argc > 1 ? atoi(argv[1]) : 24;
+  bool ok = true;
+  const int sizes[2][2] = {{1000, 100}, {100, 1000}};
+  for ( int s=0; s < 2; s++ )
+  {
+    const cv::Mat image = make_image(sizes[s][0], sizes[s][1]);
+    ok = run(image, band_rows) && ok;
+    ok = run(image, image.rows) && ok;
+  }
+  return ok ? 0 : 1;
+}
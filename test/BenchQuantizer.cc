@@ -0,0 +1,77 @@
+#include "Quantizer.hpp"
+
+#include <cmath>
+#include <chrono>
+#include <memory>
+
+USE_PRJ_NAMESPACE;
+
+/// mean squared BGR error per channel
+static double mse(const cv::Mat & a, const cv::Mat & b)
+{
+  double sum = 0;
+  for ( int j=0; j < a.rows; j++ )
+  {
+    const unsigned char * p = a.ptr<unsigned char>(j);
+    const unsigned char * q = b.ptr<unsigned char>(j);
+    for ( int i=0; i < 3*a.cols; i++ )
+    {
+      const double d = double(p[i]) - double(q[i]);
+      sum += d*d;
+    }
+  }
+  return sum / (3.0*a.total());
+}
+
+int main(int argc, char * argv[])
+{
+  cv::Mat image;
+  if ( argc > 1 )
+  {
+    image = cv::imread(argv[1], CV_LOAD_IMAGE_COLOR);
+    ASSERT_MSG(image.data, "No image data");
+  }
+  else
+  {
+    // smooth gradients with some noise, when no photo is given
+    image.create(1080, 1920, CV_8UC3);
+    cv::RNG rng(1);
+    for ( int j=0; j < image.rows; j++ )
+      for ( int i=0; i < image.cols; i++ )
+      {
+        image.at<cv::Vec3b>(j, i) = cv::Vec3b(
+            cv::saturate_cast<uchar>(255*i/image.cols + rng.uniform(-8, 8)),
+            cv::saturate_cast<uchar>(255*j/image.rows + rng.uniform(-8, 8)),
+            cv::saturate_cast<uchar>(128 + 127*std::sin(0.01*(i+j))));
+      }
+  }
+  const SizeType colors = argc > 2 ? atoi(argv[2]) : 16;
+  const SizeType runs = argc > 3 ? atoi(argv[3]) : 5;
+  INFO("%dx%d, %lu colors, best of %lu runs", image.cols, image.rows, colors, runs);
+
+  std::unique_ptr<Quantizer> quantizers[] = {
+    std::unique_ptr<Quantizer>(new MedianCutQuantizer),
+    std::unique_ptr<Quantizer>(new HistogramQuantizer(5)),
+    std::unique_ptr<Quantizer>(new KMeansQuantizer(6, 4)),
+    std::unique_ptr<Quantizer>(new OctreeQuantizer),
+    std::unique_ptr<Quantizer>(new UniformQuantizer)
+  };
+  for ( SizeType q=0; q < sizeof(quantizers)/sizeof(quantizers[0]); q++ )
+  {
+    cv::Mat output;
+    double best = 1e30;
+    for ( SizeType r=0; r < runs; r++ )
+    {
+      output = image.clone();
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      quantizers[q]->reduce(colors, output);
+      best = std::min(best, std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - start).count());
+    }
+    const double e = mse(image, output);
+    INFO("%-22s %9.2f ms  mse %8.2f  psnr %6.2f dB", quantizers[q]->name(), best, e,
+         e > 0 ? 10*std::log10(255.0*255.0/e) : 99.0);
+  }
+
+  return 0;
+}
@@ -0,0 +1,122 @@
+/**
+ * SeparableResize against cv::resize.
+ *
+ *   BenchResize <image> [factor] [runs]
+ *
+ * Downscales by factor and upscales back by the same factor with every
+ * kernel, and reports the best time of each and the largest difference
+ * to the matching OpenCV interpolation. Mitchell has no counterpart and
+ * is only timed. The first run of each engine builds its weight tables,
+ * the rest reuse them as a stream of same-sized frames does.
+ *
+ * Finally BilinearResampler is timed with the histogram quantizers and
+ * colors reduced after resizing against reduced while resizing.
+ */
+#include "SeparableResize.hpp"
+#include "BilinearResampler.hpp"
+
+#include <chrono>
+#include <cstdlib>
+
+USE_PRJ_NAMESPACE;
+
+static int max_difference(const cv::Mat & a, const cv::Mat & b)
+{
+  cv::Mat diff;
+  cv::absdiff(a, b, diff);
+  double max_value = 0;
+  cv::minMaxLoc(diff.reshape(1), 0, &max_value);
+  return int(max_value);
+}
+
+template <typename Kernel>
+static void bench(const char * name, int interpolation, const cv::Mat & image,
+                  SizeType w, SizeType h, SizeType runs)
+{
+  SeparableResize<Kernel> engine;
+  cv::Mat ours, theirs;
+  double best_ours = 1e30, best_theirs = 1e30;
+  for ( SizeType r=0; r < runs; r++ )
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    engine.resize(image, ours, w, h);
+    best_ours = std::min(best_ours, std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count());
+
+    if ( interpolation < 0 ) continue;
+    start = std::chrono::steady_clock::now();
+    cv::resize(image, theirs, cv::Size(int(w), int(h)), 0, 0, interpolation);
+    best_theirs = std::min(best_theirs, std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count());
+  }
+  if ( interpolation < 0 )
+  {
+    INFO("%-9s %5lux%-5lu %8.2f ms", name, w, h, best_ours);
+    return;
+  }
+  INFO("%-9s %5lux%-5lu %8.2f ms, cv::resize %8.2f ms, max difference %d",
+       name, w, h, best_ours, best_theirs, max_difference(ours, theirs));
+}
+
+static void bench_all(const cv::Mat & image, SizeType w, SizeType h, SizeType runs)
+{
+  bench<NearestKernel>("nearest", cv::INTER_NEAREST, image, w, h, runs);
+  bench<BilinearKernel>("bilinear", cv::INTER_LINEAR, image, w, h, runs);
+  bench<BicubicKernel>("bicubic", cv::INTER_CUBIC, image, w, h, runs);
+  bench<LanczosKernel>("lanczos", cv::INTER_LANCZOS4, image, w, h, runs);
+  bench<MitchellKernel>("mitchell", -1, image, w, h, runs);
+  bench<AreaKernel>("area", cv::INTER_AREA, image, w, h, runs);
+}
+
+static void bench_fused(const cv::Mat & image, SizeType w, SizeType h, SizeType runs)
+{
+  const Resampler::QuantizeMode modes[2] = {Resampler::QUANTIZE_HISTOGRAM, Resampler::QUANTIZE_KMEANS};
+  const char * names[2] = {"histogram", "k-means"};
+  for ( int m=0; m < 2; m++ )
+  {
+    double best[2] = {1e30, 1e30};
+    cv::Mat outputs[2];
+    for ( int fused=0; fused < 2; fused++ )
+    {
+      BilinearResampler resampler(16);
+      resampler.setQuantizeMode(modes[m]);
+      resampler.setFusedQuantize(fused == 1);
+      resampler.load(image);
+      for ( SizeType r=0; r < runs; r++ )
+      {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        resampler.resampleTo(w, h, outputs[fused]);
+        best[fused] = std::min(best[fused], std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count());
+      }
+    }
+    INFO("%-9s %5lux%-5lu %8.2f ms, fused %8.2f ms, max difference %d",
+         names[m], w, h, best[0], best[1], max_difference(outputs[0], outputs[1]));
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  if ( argc < 2 )
+  {
+    INFO("Please give me an image.");
+    return -1;
+  }
+  const cv::Mat image = cv::imread(argv[1], CV_LOAD_IMAGE_COLOR);
+  ASSERT_MSG(image.data, "No image data");
+  const SizeType factor = argc > 2 ? atoi(argv[2]) : 4;
+  const SizeType runs = argc > 3 ? atoi(argv[3]) : 10;
+
+  INFO("%dx%d, best of %lu runs, %d threads", image.cols, image.rows, runs, cv::getNumThreads());
+  const SizeType w = image.cols/factor, h = image.rows/factor;
+  bench_all(image, w, h, runs);
+
+  cv::Mat small;
+  cv::resize(image, small, cv::Size(int(w), int(h)), 0, 0, cv::INTER_AREA);
+  bench_all(small, w*factor, h*factor, runs);
+
+  bench_fused(image, w, h, runs);
+  bench_fused(small, w*factor, h*factor, runs);
+
+  return 0;
+}
@@ -0,0 +1,301 @@
+/**
+ * Row-major pixel passes of the library against their old column order.
+ *
+ *   BenchTraversal [width] [height] [runs]
+ *
+ * Times MedianCutQuantizer::reduce() (reduce_color), and on a converged
+ * AbstractionResampler update_superpixels(), finalize() and
+ * visualizeSuperpixel(), on a wide synthetic image. The column-major
+ * passes they replaced run on the same input and state, and their
+ * results must be bit-identical. On Linux the cache misses of every pass
+ * are counted with perf_event_open as well. Returns 1 on any difference.
+ */
+#include "AbstractionResampler.hpp"
+#include "cvMedianCut.hpp"
+
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <opencv2/opencv.hpp>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+USE_PRJ_NAMESPACE;
+
+/// hardware cache miss counter of this thread, silent when unavailable
+class CacheMisses {
+public:
+  CacheMisses()
+    : _fd(-1)
+  {
+#ifdef __linux__
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    _fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+  }
+
+  ~CacheMisses()
+  {
+#ifdef __linux__
+    if ( _fd >= 0 ) close(_fd);
+#endif
+  }
+
+  bool valid() const
+  {
+    return _fd >= 0;
+  }
+
+  void start()
+  {
+#ifdef __linux__
+    if ( _fd < 0 ) return;
+    ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+  }
+
+  long long stop()
+  {
+    long long count = 0;
+#ifdef __linux__
+    if ( _fd < 0 ) return 0;
+    ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+    if ( read(_fd, &count, sizeof(count)) != sizeof(count) ) count = 0;
+#endif
+    return count;
+  }
+
+protected:
+  int _fd;
+};
+
+/// best time of runs calls to pass, and the cache misses of that call
+template <typename Pass>
+static void measure(const char * name, SizeType runs, CacheMisses & misses, const Pass & pass)
+{
+  double best = 1e30;
+  long long best_misses = 0;
+  for ( SizeType r=0; r < runs; r++ )
+  {
+    misses.start();
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pass();
+    const double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    const long long count = misses.stop();
+    if ( ms < best )
+    {
+      best = ms;
+      best_misses = count;
+    }
+  }
+  if ( misses.valid() )
+  {
+    INFO("%-34s %9.2f ms  %12lld cache misses", name, best, best_misses);
+  }
+  else
+  {
+    INFO("%-34s %9.2f ms", name, best);
+  }
+}
+
+static bool same(const cv::Mat & a, const cv::Mat & b)
+{
+  if ( a.rows != b.rows || a.cols != b.cols || a.type() != b.type() ) return false;
+  for ( int j=0; j < a.rows; j++ )
+  {
+    if ( std::memcmp(a.ptr(j), b.ptr(j), a.cols*a.elemSize()) ) return false;
+  }
+  return true;
+}
+
+/// MedianCutQuantizer::reduce() as it was, gathering column by column
+static void column_major_reduce(SizeType nColors, cv::Mat & image)
+{
+  cvMedianCut cut(nColors);
+  cut.setParallelSplits(cv::getNumThreads());
+  std::vector<cv::Vec3b> data;
+  for ( int i=0; i < image.cols; i++ )
+    for ( int j=0; j < image.rows; j++ )
+    {
+      data.push_back(image.at<cv::Vec3b>(j, i));
+    }
+  cut.process(data);
+  const std::vector<cv::Vec3b> & palette = cut.getPalette();
+  const uint16_t * label = cut.getLabels().data();
+  for ( int i=0; i < image.cols; i++ )
+    for ( int j=0; j < image.rows; j++ )
+    {
+      image.at<cv::Vec3b>(j, i) = palette[*label++];
+    }
+}
+
+/// AbstractionResampler with its passes exposed and their old column order
+class Traversals : public AbstractionResampler {
+public:
+  Traversals(SizeType nc)
+    : AbstractionResampler(nc)
+  {
+  }
+
+  void run_update_superpixels()
+  {
+    update_superpixels();
+  }
+
+  void run_finalize()
+  {
+    finalize();
+  }
+
+  /// finalize() writing the output column by column
+  void column_major_output(cv::Mat & output)
+  {
+    const bool use_best = !_converged && !_best_assoc.empty();
+    const std::vector<LabelType> & sp_assoc = use_best ? _best_assoc : _sp_assoc;
+    std::vector<cv::Vec3b> palette_bgr = _fixed_bgr;
+    if ( _fixed_lab.empty() )
+    {
+      std::vector<cv::Vec3f> boosted = use_best ? _best_palette : get_averaged_palette();
+      palette_bgr.resize(boosted.size());
+      for ( SizeType k=0; k < boosted.size(); k++ )
+      {
+        boosted[k][1] *= 1.1;
+        boosted[k][2] *= 1.1;
+        palette_bgr[k] = lab_to_bgr(boosted[k]);
+      }
+    }
+    output.create(_output_height, _output_width, CV_8UC3);
+    for ( SizeType i=0; i < _output_width; i++ )
+      for ( SizeType j=0; j < _output_height; j++ )
+      {
+        output.at<cv::Vec3b>(j, i) = palette_bgr[sp_assoc[j*_output_width+i]];
+      }
+  }
+
+  /// visualizeSuperpixel() at full scale, column by column
+  void column_major_overlay(cv::Mat & output)
+  {
+    const int n_neighbors = 5;
+    const int dx[n_neighbors] = {-1,  0,  1, 1, 1};
+    const int dy[n_neighbors] = {-1, -1, -1, 0, 1};
+    const int w = int(_input_width), h = int(_input_height);
+    output.create(h, w, CV_8UC3);
+    for ( int i=0; i < w; i++ )
+      for ( int j=0; j < h; j++ )
+      {
+        const LabelType id = _pixel_map[j*_input_width+i];
+        SizeType cnt = 0;
+        for ( int k=0; k < n_neighbors; k++ )
+        {
+          const int x = i + dx[k];
+          const int y = j + dy[k];
+          if ( 0 <= x && x < w && 0 <= y && y < h && _pixel_map[y*_input_width+x] != id )
+          {
+            cnt++;
+          }
+        }
+        output.at<cv::Vec3b>(j, i) = cnt > 1 ? cv::Vec3b(0, 0, 255) :
+                                     lab_to_bgr(_palette[_sp_assoc[id]]);
+      }
+    for ( SizeType k=0; k < _n_superpixels; k++ )
+    {
+      const int x = std::min(int(_sp_position[k][0]*w), w-1);
+      const int y = std::min(int(_sp_position[k][1]*h), h-1);
+      output.at<cv::Vec3b>(y, x) = cv::Vec3b(0, 255, 0);
+      for ( int n=0; n < n_neighbors; n++ )
+      {
+        const int xx = x+dx[n];
+        const int yy = y+dy[n];
+        if ( 0 <= xx && xx < w && 0 <= yy && yy < h )
+        {
+          output.at<cv::Vec3b>(yy, xx) = cv::Vec3b(0, 255, 0);
+        }
+      }
+    }
+  }
+};
+
+int main(int argc, char * argv[])
+{
+  const int width = argc > 1 ? atoi(argv[1]) : 8192;
+  const int height = argc > 2 ? atoi(argv[2]) : 512;
+  const SizeType runs = argc > 3 ? atoi(argv[3]) : 5;
+  const SizeType colors = 16;
+
+  // gradients with noise and flat patches, wide enough that a column of
+  // pixels touches a new cache line per pixel
+  cv::Mat image(height, width, CV_8UC3);
+  cv::RNG rng(11);
+  for ( int j=0; j < height; j++ )
+  {
+    cv::Vec3b * row = image.ptr<cv::Vec3b>(j);
+    for ( int i=0; i < width; i++ )
+    {
+      row[i] = (i/211 + j/97) % 4 == 0 ? cv::Vec3b(40, 90, 160) :
+               cv::Vec3b(cv::saturate_cast<uchar>(255*i/width + rng.uniform(-8, 8)),
+                         cv::saturate_cast<uchar>(255*j/height + rng.uniform(-8, 8)),
+                         cv::saturate_cast<uchar>(128 + rng.uniform(-40, 40)));
+    }
+  }
+
+  CacheMisses misses;
+  INFO("%dx%d, best of %lu runs%s", width, height, runs,
+       misses.valid() ? "" : ", no cache miss counter available");
+  bool ok = true;
+
+  // reduce_color
+  cv::Mat reduced[2];
+  measure("reduce_color, column-major", runs, misses, [&]()
+  {
+    image.copyTo(reduced[0]);
+    column_major_reduce(colors, reduced[0]);
+  });
+  const MedianCutQuantizer quantizer;
+  measure("MedianCutQuantizer::reduce", runs, misses, [&]()
+  {
+    image.copyTo(reduced[1]);
+    quantizer.reduce(colors, reduced[1]);
+  });
+  ok = same(reduced[0], reduced[1]) && ok;
+  INFO("reduce_color: %s", same(reduced[0], reduced[1]) ? "identical" : "DIFFERENT");
+
+  // the abstraction passes on the state of a finished run
+  Traversals resampler(colors);
+  AbstractionResampler::ConvergencePolicy policy;
+  policy.max_iterations = 20;
+  resampler.load(image);
+  resampler.resample(width/16, height/16, policy);
+
+  cv::Mat outputs[2];
+  measure("finalize, column-major", runs, misses, [&]() { resampler.column_major_output(outputs[0]); });
+  measure("AbstractionResampler::finalize", runs, misses, [&]() { resampler.run_finalize(); });
+  outputs[1] = resampler.getOutput();
+  ok = same(outputs[0], outputs[1]) && ok;
+  INFO("finalize: %s", same(outputs[0], outputs[1]) ? "identical" : "DIFFERENT");
+
+  cv::Mat overlays[2];
+  measure("visualizeSuperpixel, column-major", runs, misses, [&]() { resampler.column_major_overlay(overlays[0]); });
+  measure("visualizeSuperpixel", runs, misses, [&]() { resampler.visualizeSuperpixel(overlays[1]); });
+  ok = same(overlays[0], overlays[1]) && ok;
+  INFO("visualizeSuperpixel: %s", same(overlays[0], overlays[1]) ? "identical" : "DIFFERENT");
+
+  // already row-major before, timed for completeness
+  measure("update_superpixels", runs, misses, [&]() { resampler.run_update_superpixels(); });
+
+  return ok ? 0 : 1;
+}
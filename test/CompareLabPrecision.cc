@@ -0,0 +1,102 @@
+/**
+ * Fixed-point against float Lab in AbstractionResampler.
+ *
+ *   CompareLabPrecision <image> [factor] [iterations]
+ *
+ * Reports the rounding error of the 16-bit planes, which must stay
+ * within half a step per channel, and how far the abstraction drifts
+ * from the float result, which must stay below a mean delta E of 1, about
+ * one just noticeable difference. Returns 1 if either bound is exceeded.
+ */
+#include "AbstractionResampler.hpp"
+#include "SlicKernel.hpp"
+
+#include <cmath>
+#include <chrono>
+
+USE_PRJ_NAMESPACE;
+
+static double delta_e(const cv::Vec3f & p, const cv::Vec3f & q)
+{
+  const double dL = p[0]-q[0], da = p[1]-q[1], db = p[2]-q[2];
+  return std::sqrt(dL*dL + da*da + db*db);
+}
+
+int main(int argc, char * argv[])
+{
+  if ( argc < 2 )
+  {
+    INFO("Please give me an image.");
+    return -1;
+  }
+  const cv::Mat image = cv::imread(argv[1], CV_LOAD_IMAGE_COLOR);
+  ASSERT_MSG(image.data, "No image data");
+  const int factor = argc > 2 ? atoi(argv[2]) : 12;
+  AbstractionResampler::ConvergencePolicy policy;
+  if ( argc > 3 )
+  {
+    policy.max_iterations = atoi(argv[3]);
+  }
+
+  // rounding error of the input planes
+  cv::Mat L, a, b;
+  bgr_to_lab_planes(image, L, a, b);
+  double input_error = 0;
+  for ( int j=0; j < image.rows; j++ )
+  {
+    const float * planes[3] = {L.ptr<float>(j), a.ptr<float>(j), b.ptr<float>(j)};
+    for ( int i=0; i < image.cols; i++ )
+    {
+      cv::Vec3f exact, fixed;
+      for ( int c=0; c < 3; c++ )
+      {
+        exact[c] = planes[c][i];
+        fixed[c] = lab_value(cv::saturate_cast<int16_t>(planes[c][i]/lab_fixed_step));
+      }
+      input_error = std::max(input_error, delta_e(exact, fixed));
+    }
+  }
+  const double bound = std::sqrt(3.0) * lab_fixed_step / 2;
+  INFO("input: max delta E %.5f, bound %.5f", input_error, bound);
+
+  // the whole abstraction in both modes
+  cv::Mat outputs[2];
+  for ( int mode=0; mode < 2; mode++ )
+  {
+    AbstractionResampler resampler(8);
+    resampler.setFixedPointLab(mode == 1);
+    resampler.load(image);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    resampler.resample(image.cols/factor, image.rows/factor, policy);
+    outputs[mode] = resampler.getOutput().clone();
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    INFO("%-11s %.3fs, %lu iterations", mode ? "fixed point" : "float",
+         seconds, resampler.getIterations());
+  }
+
+  SizeType same = 0;
+  double max_error = 0, sum_error = 0;
+  for ( int j=0; j < outputs[0].rows; j++ )
+  {
+    const cv::Vec3b * p = outputs[0].ptr<cv::Vec3b>(j);
+    const cv::Vec3b * q = outputs[1].ptr<cv::Vec3b>(j);
+    for ( int i=0; i < outputs[0].cols; i++ )
+    {
+      if ( p[i] == q[i] )
+      {
+        same++;
+        continue;
+      }
+      const double e = delta_e(bgr_to_lab(p[i]), bgr_to_lab(q[i]));
+      max_error = std::max(max_error, e);
+      sum_error += e;
+    }
+  }
+  const SizeType n = outputs[0].total();
+  const double output_bound = 1.0;
+  INFO("output: %.2f%% identical pixels, mean delta E %.4f, bound %.4f, max delta E %.4f",
+       100.0*same/n, sum_error/n, output_bound, max_error);
+
+  return input_error <= bound && sum_error/n <= output_bound ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+/**
+ * Vectorized SLIC distance against the scalar reference.
+ *
+ *   CompareSlicSpan [spans]
+ *
+ * Scores random spans of random rows with slic_span() and with a loop
+ * over slic_distance(), for float and fixed-point planes, and requires
+ * the distances and labels to be bitwise identical. Some pixels start at
+ * exactly their reference distance, so ties must keep the old label.
+ * Returns 1 on any mismatch.
+ */
+#include "SlicKernel.hpp"
+
+#include <random>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+USE_PRJ_NAMESPACE;
+
+static const SizeType row_width = 203;
+
+template <typename T>
+static T plane_value(float v);
+
+template <>
+float plane_value<float>(float v)
+{
+  return v;
+}
+
+template <>
+int16_t plane_value<int16_t>(float v)
+{
+  return int16_t(std::floor(v/lab_fixed_step + 0.5f));
+}
+
+template <typename T>
+static SizeType compare(const char * type, SizeType n_spans)
+{
+  std::mt19937 rng(17);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::vector<T> L(row_width), a(row_width), b(row_width);
+  std::vector<float> dist(row_width), ref_dist(row_width);
+  std::vector<uint32_t> label(row_width), ref_label(row_width);
+
+  SizeType mismatches = 0;
+  for ( SizeType s=0; s < n_spans; s++ )
+  {
+    for ( SizeType i=0; i < row_width; i++ )
+    {
+      L[i] = plane_value<T>(100*unit(rng));
+      a[i] = plane_value<T>(220*unit(rng)-110);
+      b[i] = plane_value<T>(220*unit(rng)-110);
+    }
+    const SizeType row = rng() % 4096;
+    const float center[2] = {row_width*unit(rng), row + 40*unit(rng) - 20};
+    const float color[3] = {100*unit(rng), 220*unit(rng)-110, 220*unit(rng)-110};
+    const float weight = 4*unit(rng);
+    const uint32_t id = rng();
+    SizeType x0 = rng() % row_width, x1 = rng() % (row_width+1);
+    if ( x0 > x1 ) std::swap(x0, x1);
+
+    for ( SizeType x=0; x < row_width; x++ )
+    {
+      const float d = slic_distance(lab_value(L[x]), lab_value(a[x]), lab_value(b[x]),
+                                    float(x)-center[0], float(row)-center[1], color, weight);
+      const unsigned r = rng() % 3;
+      dist[x] = r == 0 ? d : r == 1 ? 2*d : 0.5f*d;
+      label[x] = rng();
+      ref_dist[x] = dist[x];
+      ref_label[x] = label[x];
+      if ( x0 <= x && x < x1 && d < ref_dist[x] )
+      {
+        ref_dist[x] = d;
+        ref_label[x] = id;
+      }
+    }
+
+    slic_span(&L[0], &a[0], &b[0], &dist[0], &label[0], x0, x1, row, center, color, weight, id);
+    if ( std::memcmp(&dist[0], &ref_dist[0], row_width*sizeof(float)) ||
+         label != ref_label )
+    {
+      mismatches++;
+    }
+  }
+  INFO("%-11s %lu of %lu spans differ", type, mismatches, n_spans);
+  return mismatches;
+}
+
+int main(int argc, char * argv[])
+{
+  const SizeType n_spans = argc > 1 ? atoi(argv[1]) : 10000;
+  const SizeType mismatches = compare<float>("float", n_spans) +
+                              compare<int16_t>("fixed point", n_spans);
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+/**
+ * Concurrent median cut splits against the serial order.
+ *
+ *   ParallelMedianCut [pixels] [colors]
+ *
+ * Clusters a large image-like input, plain and weighted, with one split
+ * at a time and with speculative splits of up to 2, 4 and 8 clusters.
+ * The input is far above the size below which clusters are never split
+ * ahead, so the batches are real. Palette order and labels must be
+ * exactly those of the serial run. Returns 1 on any difference.
+ */
+#include "cvMedianCut.hpp"
+
+#include <vector>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+
+USE_PRJ_NAMESPACE;
+
+static bool same_as_serial(const std::vector<cv::Vec3b> & data, const std::vector<SizeType> * weights,
+                           SizeType colors)
+{
+  cvMedianCut serial(colors);
+  serial.setParallelSplits(1);
+  if ( weights ) serial.process(data, *weights);
+  else serial.process(data);
+
+  bool same = true;
+  const SizeType tasks[3] = {2, 4, 8};
+  for ( int t=0; t < 3; t++ )
+  {
+    cvMedianCut cut(colors);
+    cut.setParallelSplits(tasks[t]);
+    if ( weights ) cut.process(data, *weights);
+    else cut.process(data);
+    const bool ok = cut.getPalette() == serial.getPalette() && cut.getLabels() == serial.getLabels();
+    INFO("%s, %lu tasks: %lu colors, %s", weights ? "weighted" : "plain", tasks[t],
+         SizeType(cut.getPalette().size()), ok ? "same as serial" : "DIFFERENT");
+    same = same && ok;
+  }
+  return same;
+}
+
+int main(int argc, char * argv[])
+{
+  const SizeType n = argc > 1 ? atoi(argv[1]) : 1 << 20;
+  const SizeType colors = argc > 2 ? atoi(argv[2]) : 64;
+
+  // smooth gradients with noise and a few flat regions, like a photo
+  std::vector<cv::Vec3b> data(n);
+  std::vector<SizeType> weights(n);
+  cv::RNG rng(5);
+  for ( SizeType k=0; k < n; k++ )
+  {
+    const int x = int(k % 1024), y = int(k / 1024);
+    if ( (x/128 + y/96) % 5 == 0 )
+    {
+      data[k] = cv::Vec3b(30, 60, 90);
+    }
+    else
+    {
+      data[k] = cv::Vec3b(cv::saturate_cast<uchar>(x/4 + rng.uniform(-6, 6)),
+                          cv::saturate_cast<uchar>(y/4 + rng.uniform(-6, 6)),
+                          cv::saturate_cast<uchar>((x+y)/8 + rng.uniform(0, 32)));
+    }
+    weights[k] = 1 + rng.uniform(0, 16);
+  }
+
+  const bool ok = same_as_serial(data, NULL, colors) && same_as_serial(data, &weights, colors);
+  return ok ? 0 : 1;
+}
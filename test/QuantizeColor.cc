@@ -23,17 +23,20 @@ int main(int argc, char * argv[])
 
   std::vector<cv::Vec3b> data;
   cvMedianCut cut(8);
-  for ( int i=0; i < image.cols; i++ )
-    for ( int j=0; j < image.rows; j++ )
-    {
-      data.push_back(image.at<cv::Vec3b>(j, i));
-    }
+  for ( int j=0; j < image.rows; j++ )
+  {
+    const cv::Vec3b * row = image.ptr<cv::Vec3b>(j);
+    data.insert(data.end(), row, row+image.cols);
+  }
   cut.process(data);
-  for ( int i=0; i < image.cols; i++ )
-    for ( int j=0; j < image.rows; j++ )
+  for ( int j=0; j < image.rows; j++ )
+  {
+    cv::Vec3b * row = image.ptr<cv::Vec3b>(j);
+    for ( int i=0; i < image.cols; i++ )
     {
-      image.at<cv::Vec3b>(j, i) = cut.getResult(i*image.rows+j);
+      row[i] = cut.getResult(j*image.cols+i);
     }
+  }
 
   cv::namedWindow("Quantized", CV_WINDOW_AUTOSIZE);
   cv::imshow("Quantized", image);
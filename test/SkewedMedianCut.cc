@@ -0,0 +1,47 @@
+/**
+ * Median cut on a flat region with a few outliers.
+ *
+ *   SkewedMedianCut [pixels] [outliers]
+ *
+ * More than half of the pixels share the smallest value of every
+ * channel, so the median of the first split is the minimum. Both halves
+ * of such a split must still be non-empty, and the outliers must keep
+ * colors of their own. Returns 1 on failure.
+ */
+#include "cvMedianCut.hpp"
+
+#include <set>
+#include <vector>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+
+USE_PRJ_NAMESPACE;
+
+int main(int argc, char * argv[])
+{
+  const SizeType n = argc > 1 ? atoi(argv[1]) : 10000;
+  const SizeType outliers = argc > 2 ? atoi(argv[2]) : 5;
+  ASSERT_MSG(outliers < n/2, "too many outliers");
+
+  std::vector<cv::Vec3b> data(n, cv::Vec3b(10, 20, 30));
+  for ( SizeType k=0; k < outliers; k++ )
+  {
+    data[k*(n/outliers)] = cv::Vec3b(200, 20+k, 250-k);
+  }
+
+  cvMedianCut cut(8);
+  cut.process(data);
+
+  std::set<int> colors;
+  for ( SizeType k=0; k < n; k++ )
+  {
+    const cv::Vec3b & c = cut.getResult(k);
+    colors.insert(c[0] | (c[1] << 8) | (c[2] << 16));
+  }
+  const bool flat_kept = cut.getResult(1) == cv::Vec3b(10, 20, 30);
+  const bool outlier_kept = cut.getResult(0)[0] > 100;
+  INFO("%lu colors, flat region %s, outliers %s", SizeType(colors.size()),
+       flat_kept ? "kept" : "lost", outlier_kept ? "kept" : "lost");
+
+  return flat_kept && outlier_kept && colors.size() > 1 ? 0 : 1;
+}
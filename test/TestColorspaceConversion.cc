@@ -1,9 +1,65 @@
 #include "AbstractionResampler.hpp"
 
+#include <cmath>
+#include <chrono>
 #include <opencv2/opencv.hpp>
 
 USE_PRJ_NAMESPACE;
 
+static double milliseconds_since(const std::chrono::steady_clock::time_point & start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// the table-driven converter against OpenCV's float path
+static void compare_with_opencv(const cv::Mat & image)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  cv::Mat reference;
+  image.convertTo(reference, CV_32FC3, 1./255);
+  cv::cvtColor(reference, reference, CV_BGR2Lab);
+  const double opencv_ms = milliseconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  cv::Mat lab;
+  bgr_to_lab(image, lab);
+  const double lab_ms = milliseconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  cv::Mat L, a, b;
+  bgr_to_lab_planes(image, L, a, b);
+  const double planes_ms = milliseconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  cv::Mat bgr;
+  lab_to_bgr(lab, bgr);
+  const double bgr_ms = milliseconds_since(start);
+
+  double max_delta_e = 0;
+  int max_difference = 0;
+  for ( int j=0; j < image.rows; j++ )
+  {
+    const cv::Vec3f * p = reference.ptr<cv::Vec3f>(j);
+    const cv::Vec3f * q = lab.ptr<cv::Vec3f>(j);
+    const cv::Vec3b * c = image.ptr<cv::Vec3b>(j);
+    const cv::Vec3b * d = bgr.ptr<cv::Vec3b>(j);
+    for ( int i=0; i < image.cols; i++ )
+    {
+      const cv::Vec3f e = p[i] - q[i];
+      max_delta_e = std::max(max_delta_e, std::sqrt(double(e[0]*e[0] + e[1]*e[1] + e[2]*e[2])));
+      for ( int k=0; k < 3; k++ )
+      {
+        max_difference = std::max(max_difference, std::abs(int(c[i][k]) - int(d[i][k])));
+      }
+    }
+  }
+  printf("BGR to Lab: OpenCV %.2f ms, interleaved %.2f ms, planar %.2f ms\n",
+         opencv_ms, lab_ms, planes_ms);
+  printf("Lab to BGR: %.2f ms\n", bgr_ms);
+  printf("max delta E to OpenCV %.4f, max round trip difference %d\n",
+         max_delta_e, max_difference);
+}
+
 int main(int argc, const char * argv[])
 {
   cv::Mat image;
@@ -15,6 +71,8 @@ int main(int argc, const char * argv[])
     return -1;
   }
 
+  compare_with_opencv(image);
+
   cv::namedWindow("Origin", CV_WINDOW_AUTOSIZE);
   cv::imshow("Origin", image);
 